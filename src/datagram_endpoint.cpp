@@ -0,0 +1,367 @@
+/* datagram_endpoint.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   DatagramEndpoint implementation
+*/
+
+#include "datagram_endpoint.h"
+#include "utils.h"
+
+#include <cassert>
+#include <cstring>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#ifndef UDP_SEGMENT
+# define UDP_SEGMENT 103
+#endif
+
+namespace slick {
+
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+namespace {
+
+int bindSocket(int family, Port port)
+{
+    int fd = socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    FdGuard guard(fd);
+    int ret;
+
+    if (family == AF_INET6) {
+        int val = false;
+        ret = setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &val, sizeof val);
+        SLICK_CHECK_ERRNO(!ret, "DatagramEndpoint.setsockopt.IPV6_V6ONLY");
+
+        struct sockaddr_in6 addr;
+        std::memset(&addr, 0, sizeof addr);
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_any;
+        addr.sin6_port = htons(port);
+        ret = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr);
+    }
+    else {
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof addr);
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        ret = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr);
+    }
+
+    return ret < 0 ? -1 : guard.release();
+}
+
+/** IPv4 destinations have to be v4-mapped to go through a dual-stack
+    socket. Returns false if the address can't be reached from the socket.
+ */
+bool normalize(int family, SockAddr& sa)
+{
+    sa.socktype = SOCK_DGRAM;
+    sa.protocol = IPPROTO_UDP;
+
+    if (sa.family == family) return true;
+    if (family != AF_INET6 || sa.family != AF_INET) return false;
+
+    struct sockaddr_in in4;
+    std::memcpy(&in4, &sa.addr, sizeof in4);
+
+    struct sockaddr_in6 in6;
+    std::memset(&in6, 0, sizeof in6);
+    in6.sin6_family = AF_INET6;
+    in6.sin6_port = in4.sin_port;
+    in6.sin6_addr.s6_addr[10] = 0xFF;
+    in6.sin6_addr.s6_addr[11] = 0xFF;
+    std::memcpy(&in6.sin6_addr.s6_addr[12], &in4.sin_addr, sizeof in4.sin_addr);
+
+    sa.family = AF_INET6;
+    sa.len = sizeof in6;
+    std::memcpy(&sa.addr, &in6, sizeof in6);
+    return true;
+}
+
+bool operator==(const SockAddr& lhs, const SockAddr& rhs)
+{
+    return lhs.len == rhs.len && !std::memcmp(&lhs.addr, &rhs.addr, lhs.len);
+}
+
+} // namespace anonymous
+
+
+/******************************************************************************/
+/* DATAGRAM ENDPOINT                                                          */
+/******************************************************************************/
+
+DatagramEndpoint::
+DatagramEndpoint(Port port, size_t maxDatagram) :
+    maxDatagram(maxDatagram), gso_(false), polling(false)
+{
+    assert(maxDatagram > sizeof(Payload::SizeT) && maxDatagram <= MaxDatagram);
+
+    family = AF_INET6;
+    socket_ = bindSocket(family, port);
+    if (socket_ < 0) socket_ = bindSocket(family = AF_INET, port);
+    SLICK_CHECK_ERRNO(socket_ >= 0, "DatagramEndpoint.bind");
+
+    poller.add(socket_, EPOLLIN);
+    poller.add(sends.fd(), EPOLLIN);
+
+    // Reading one byte past the max is how oversized datagrams are spotted
+    // without relying on MSG_TRUNC.
+    recvBuffer.resize(Batch * (maxDatagram + 1));
+
+    std::memset(recvMsgs, 0, sizeof recvMsgs);
+    for (size_t i = 0; i < Batch; ++i) {
+        recvIov[i].iov_base = &recvBuffer[i * (maxDatagram + 1)];
+        recvIov[i].iov_len = maxDatagram + 1;
+
+        recvMsgs[i].msg_hdr.msg_iov = &recvIov[i];
+        recvMsgs[i].msg_hdr.msg_iovlen = 1;
+        recvMsgs[i].msg_hdr.msg_name = &recvAddrs[i];
+    }
+
+    typedef void (DatagramEndpoint::*SendFn) (const SockAddr&, Payload&&);
+    sends.onOperation = std::bind((SendFn)&DatagramEndpoint::send, this,
+            std::placeholders::_1, std::placeholders::_2);
+}
+
+DatagramEndpoint::
+~DatagramEndpoint()
+{
+    close(socket_);
+}
+
+void
+DatagramEndpoint::
+stopPolling()
+{
+    ThreadAwarePollable::stopPolling();
+    sends.poll();
+}
+
+Port
+DatagramEndpoint::
+port() const
+{
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof addr;
+
+    int ret = getsockname(socket_, reinterpret_cast<struct sockaddr*>(&addr), &len);
+    SLICK_CHECK_ERRNO(!ret, "DatagramEndpoint.getsockname");
+
+    if (addr.ss_family == AF_INET6)
+        return ntohs(reinterpret_cast<struct sockaddr_in6*>(&addr)->sin6_port);
+    return ntohs(reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port);
+}
+
+void
+DatagramEndpoint::
+poll(int timeoutMs)
+{
+    polling = true;
+
+    while (poller.poll(timeoutMs)) {
+        struct epoll_event ev = poller.next();
+
+        if (ev.data.fd == socket_) recv();
+        else if (ev.data.fd == sends.fd()) sends.poll(DeferCap);
+        else assert(false);
+    }
+
+    // Everything sent from the callbacks goes out in as few syscalls as
+    // possible.
+    polling = false;
+    flush();
+}
+
+void
+DatagramEndpoint::
+recv()
+{
+    while (true) {
+        for (size_t i = 0; i < Batch; ++i)
+            recvMsgs[i].msg_hdr.msg_namelen = sizeof recvAddrs[i];
+
+        int n = recvmmsg(socket_, recvMsgs, Batch, MSG_DONTWAIT, nullptr);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+
+            // ICMP errors of earlier sends are reported on the next call.
+            if (errno == ECONNREFUSED || errno == EHOSTUNREACH) continue;
+            SLICK_CHECK_ERRNO(n >= 0, "DatagramEndpoint.recvmmsg");
+        }
+
+        for (int i = 0; i < n; ++i) {
+            const auto& msg = recvMsgs[i];
+            size_t size = msg.msg_len;
+            if (size > maxDatagram) continue;
+
+            auto buffer = static_cast<const uint8_t*>(recvIov[i].iov_base);
+            Payload data = Payload::read(buffer, size);
+            if (!data || data.packetSize() != size) continue;
+
+            SockAddr addr;
+            addr.family = recvAddrs[i].ss_family;
+            addr.socktype = SOCK_DGRAM;
+            addr.protocol = IPPROTO_UDP;
+            addr.len = msg.msg_hdr.msg_namelen;
+            std::memcpy(&addr.addr, &recvAddrs[i], addr.len);
+
+            if (onPayload) onPayload(addr, std::move(data));
+        }
+
+        if (n < Batch) return;
+    }
+}
+
+void
+DatagramEndpoint::
+send(const SockAddr& addr, Payload&& data)
+{
+    if (!isPollThread()) {
+        sends.defer(addr, std::move(data));
+        return;
+    }
+
+    SockAddr dest = addr;
+    if (data.packetSize() > maxDatagram || !normalize(family, dest)) {
+        if (onDroppedPayload) onDroppedPayload(addr, std::move(data));
+        return;
+    }
+
+    sendQueue.emplace_back(std::move(dest), std::move(data));
+    if (!polling || sendQueue.size() >= Batch) flush();
+}
+
+void
+DatagramEndpoint::
+flush()
+{
+    size_t i = 0;
+    while (i < sendQueue.size()) i = sendBatch(i);
+    sendQueue.clear();
+
+    if (dropped.empty()) return;
+
+    // Callbacks are held off until the queue is done with since they may
+    // send.
+    std::vector<std::pair<SockAddr, Payload> > queue;
+    std::swap(queue, dropped);
+
+    for (auto& entry : queue) {
+        if (onDroppedPayload)
+            onDroppedPayload(entry.first, std::move(entry.second));
+    }
+}
+
+void
+DatagramEndpoint::
+dropBatch(size_t first, size_t last)
+{
+    for (size_t i = first; i < last; ++i)
+        dropped.emplace_back(std::move(sendQueue[i]));
+}
+
+/** Writes as much of the queue starting at first as fits in a single
+    sendmmsg and returns where the next batch starts.
+ */
+size_t
+DatagramEndpoint::
+sendBatch(size_t first)
+{
+    struct mmsghdr msgs[Batch];
+    size_t starts[Batch + 1];
+
+    // Reserved up front so that the headers can point into it as it's filled.
+    auto& iov = sendIov;
+    iov.clear();
+    iov.reserve(std::min<size_t>(sendQueue.size() - first, Batch * MaxSegments));
+
+    enum { ControlSize = CMSG_SPACE(sizeof(uint16_t)) };
+    alignas(struct cmsghdr) uint8_t control[Batch][ControlSize];
+
+    std::memset(msgs, 0, sizeof msgs);
+    std::memset(control, 0, sizeof control);
+
+    size_t n = 0, i = first;
+    for (; n < Batch && i < sendQueue.size(); ++n) {
+        starts[n] = i;
+
+        const auto& addr = sendQueue[i].first;
+        size_t size = sendQueue[i].second.packetSize();
+
+        // Segments must all be the same size and fit in a single datagram
+        // once coalesced.
+        size_t segments = 1;
+        while (gso_ && segments < MaxSegments
+                && i + segments < sendQueue.size()
+                && (segments + 1) * size <= MaxDatagram
+                && sendQueue[i + segments].second.packetSize() == size
+                && sendQueue[i + segments].first == addr)
+            segments++;
+
+        auto& hdr = msgs[n].msg_hdr;
+        hdr.msg_name = const_cast<struct sockaddr_storage*>(&addr.addr);
+        hdr.msg_namelen = addr.len;
+        hdr.msg_iov = iov.data() + iov.size();
+        hdr.msg_iovlen = segments;
+
+        for (size_t j = 0; j < segments; ++j, ++i) {
+            const Payload& data = sendQueue[i].second;
+            iov.push_back({ const_cast<uint8_t*>(data.packet()), data.packetSize() });
+        }
+
+        if (segments > 1) {
+            hdr.msg_control = control[n];
+            hdr.msg_controllen = ControlSize;
+
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+            uint16_t segmentSize = size;
+            std::memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof segmentSize);
+        }
+    }
+    starts[n] = i;
+
+    size_t sent = 0;
+    while (sent < n) {
+        int ret = sendmmsg(socket_, msgs + sent, n - sent, 0);
+        if (ret > 0) {
+            sent += ret;
+            continue;
+        }
+
+        if (errno == EINTR) continue;
+
+        // No GSO support so start over without it.
+        if (gso_ && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+            gso_ = false;
+            return starts[sent];
+        }
+
+        // The socket buffer is full and datagrams are lossy anyway.
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+            dropBatch(starts[sent], starts[n]);
+            return starts[n];
+        }
+
+        // Errors are specific to the destination of the first message.
+        dropBatch(starts[sent], starts[sent + 1]);
+        sent++;
+    }
+
+    return starts[n];
+}
+
+} // slick
@@ -0,0 +1,110 @@
+/* datagram_endpoint.h                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Connectionless UDP endpoint.
+*/
+
+#pragma once
+
+#include "socket.h"
+#include "payload.h"
+#include "notify.h"
+#include "defer.h"
+#include "poll.h"
+
+#include <vector>
+#include <functional>
+#include <sys/socket.h>
+
+namespace slick {
+
+
+/******************************************************************************/
+/* DATAGRAM ENDPOINT                                                          */
+/******************************************************************************/
+
+/** Exchanges payloads over UDP for small idempotent messages where setting up
+    a connection costs more than the message itself. Delivery is best effort:
+    payloads can be lost, duplicated or reordered.
+
+    Each datagram holds a single payload framed the same way as on a stream
+    which lets the receiving side drop anything truncated or malformed.
+    Datagrams are read with recvmmsg and sends are batched until the end of
+    the current poll or until the batch is full and written with sendmmsg.
+    With gso enabled, consecutive payloads of the same size to the same
+    destination are coalesced into a single UDP_SEGMENT send.
+
+    The socket is dual-stack when IPv6 is available so IPv4 senders show up as
+    v4-mapped addresses.
+ */
+struct DatagramEndpoint : public ThreadAwarePollable
+{
+    enum {
+        DefaultMaxDatagram = 1U << 13,
+
+        // Largest payload of a UDP datagram over IPv4.
+        MaxDatagram = (1U << 16) - 1 - 8 - 20,
+    };
+
+    // A port of 0 binds to an ephemeral port.
+    explicit DatagramEndpoint(
+            Port port = 0, size_t maxDatagram = DefaultMaxDatagram);
+    virtual ~DatagramEndpoint();
+
+    DatagramEndpoint(const DatagramEndpoint&) = delete;
+    DatagramEndpoint& operator=(const DatagramEndpoint&) = delete;
+
+    typedef std::function<void(const SockAddr& addr, Payload&& data)> PayloadFn;
+    PayloadFn onPayload;
+    PayloadFn onDroppedPayload;
+
+    int fd() const { return poller.fd(); }
+    void poll(int timeoutMs = 0);
+    void stopPolling();
+
+    Port port() const;
+
+    // Falls back to regular sends if the kernel doesn't support it.
+    void gso(bool enable) { gso_ = enable; }
+
+    void send(const SockAddr& addr, Payload&& data);
+    void send(const SockAddr& addr, const Payload& data)
+    {
+        send(addr, Payload(data));
+    }
+
+    // Sends are flushed on their own outside of poll.
+    void flush();
+
+private:
+
+    enum { Batch = 1 << 5, MaxSegments = 1 << 6 };
+
+    void recv();
+    size_t sendBatch(size_t first);
+    void dropBatch(size_t first, size_t last);
+
+    Epoll poller;
+    int socket_;
+    int family;
+    size_t maxDatagram;
+    bool gso_;
+    bool polling;
+
+    std::vector<uint8_t> recvBuffer;
+    struct mmsghdr recvMsgs[Batch];
+    struct iovec recvIov[Batch];
+    struct sockaddr_storage recvAddrs[Batch];
+
+    std::vector<std::pair<SockAddr, Payload> > sendQueue;
+    std::vector<std::pair<SockAddr, Payload> > dropped;
+    std::vector<struct iovec> sendIov;
+
+    enum { SendSize = 1 << 6 };
+    Defer<SendSize, SockAddr, Payload> sends;
+
+    enum { DeferCap = 1 << 6 };
+};
+
+} // slick
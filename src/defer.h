@@ -12,6 +12,7 @@
 #include "utils.h"
 
 #include <tuple>
+#include <memory>
 #include <functional>
 
 
@@ -43,53 +44,68 @@ void invoke(const Fn& fn, std::tuple<Args...>& tuple)
 /* DEFER                                                                      */
 /******************************************************************************/
 
+/** Hands operations from any thread over to the polling thread.
+
+    A defer can either own its wakeup fd or share the wakeup of its owner in
+    which case the owner is responsible for polling the wakeup and for
+    calling poll() on every defer whose bit is set. Either way the fd is only
+    written when the wakeup goes from idle to ready so a burst of operations
+    costs a single eventfd write no matter how many producers are involved.
+ */
 template<size_t QueueSize, typename... Items>
 struct Defer
 {
+    Defer() : own(new Wakeup), wakeup(own.get()), mask(1) {}
+    Defer(Wakeup& wakeup, uint64_t mask) : wakeup(&wakeup), mask(mask) {}
+
     typedef std::function<void(Items&&...)> OperationFn;
     OperationFn onOperation;
 
-    int fd() const { return notify.fd(); }
+    int fd() const { return wakeup->fd(); }
 
     void poll(size_t cap = 0)
     {
         assert(onOperation);
 
-        while (notify.poll());
+        // Anything pushed after this point will signal again.
+        if (own) own->poll();
 
         for (size_t i = 0; !queue.empty() && (!cap || i < cap); ++i) {
             auto op = queue.pop();
             details::invoke(onOperation, op);
         }
 
-        if (!queue.empty()) notify.signal();
+        if (!queue.empty()) wakeup->signal(mask);
     }
 
     template<typename... Args>
     void defer(Args&&... args)
     {
-        auto op = std::make_tuple(std::forward<Args>(args)...);
-
-        while (!queue.push(std::move(op)));
-        notify.signal();
+        // Arguments are only consumed once the push succeeds.
+        while (!queue.emplace(std::forward<Args>(args)...));
+        wakeup->signal(mask);
     }
 
+    /** Arguments are left untouched if the queue is full so that the caller
+        can still make use of them.
+     */
     template<typename... Args>
     bool tryDefer(Args&&... args)
     {
-        auto op = std::make_tuple(std::forward<Args>(args)...);
-
-        if (!queue.push(std::move(op)))
+        if (!queue.emplace(std::forward<Args>(args)...))
             return false;
 
-        notify.signal();
+        wakeup->signal(mask);
         return true;
     }
 
 private:
 
     Queue<std::tuple<Items...>, QueueSize> queue;
-    Notify notify;
+
+    std::unique_ptr<Wakeup> own;
+    Wakeup* wakeup;
+    uint64_t mask;
 };
 
 } // slick
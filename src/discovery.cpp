@@ -9,6 +9,16 @@
 
 namespace slick {
 
+ThreadAwareDiscovery::
+ThreadAwareDiscovery() :
+    retracts(wakeup, WakeRetracts),
+    publishes(wakeup, WakePublishes),
+    discovers(wakeup, WakeDiscovers),
+    forgets(wakeup, WakeForgets),
+    losts(wakeup, WakeLosts),
+    watchCounter(0)
+{}
+
 Discovery::WatchHandle
 ThreadAwareDiscovery::
 discover(const std::string& key, const WatchFn& watch)
@@ -86,19 +96,25 @@ init(SourcePoller& poller)
     using namespace std::placeholders;
 
     retracts.onOperation = std::bind(&Disc::retract, this, _1);
-    poller.add(retracts);
-
     publishes.onOperation = std::bind(&Disc::publish, this, _1, _2);
-    poller.add(publishes);
-
     discovers.onOperation = std::bind(&Disc::discoverProxy, this, _1, _2, _3);
-    poller.add(discovers);
-
     forgets.onOperation = std::bind(&Disc::forget, this, _1, _2);
-    poller.add(forgets);
-
     losts.onOperation = std::bind(&Disc::lost, this, _1, _2);
-    poller.add(losts);
+
+    poller.add(wakeup.fd(), std::bind(&Disc::pollDeferred, this));
+}
+
+void
+ThreadAwareDiscovery::
+pollDeferred()
+{
+    uint64_t ready = wakeup.poll();
+
+    if (ready & WakeRetracts)  retracts.poll();
+    if (ready & WakePublishes) publishes.poll();
+    if (ready & WakeDiscovers) discovers.poll();
+    if (ready & WakeForgets)   forgets.poll();
+    if (ready & WakeLosts)     losts.poll();
 }
 
 
@@ -107,10 +123,13 @@ ThreadAwareDiscovery::
 stopPolling()
 {
     ThreadAwarePollable::stopPolling();
+
+    wakeup.poll();
     retracts.poll();
     publishes.poll();
     discovers.poll();
     forgets.poll();
+    losts.poll();
 }
 
 
@@ -48,6 +48,8 @@ struct Discovery
 
 struct ThreadAwareDiscovery : public Discovery, public ThreadAwarePollable
 {
+    ThreadAwareDiscovery();
+
     virtual void stopPolling();
 
     virtual WatchHandle discover(const std::string& key, const WatchFn& watch);
@@ -60,6 +62,7 @@ struct ThreadAwareDiscovery : public Discovery, public ThreadAwarePollable
 protected:
 
     void init(SourcePoller& poller);
+    void pollDeferred();
 
     void discoverProxy(const std::string& key, WatchHandle handle, const WatchFn& watch);
     virtual void discoverImpl(const std::string& key, WatchHandle handle, const WatchFn& watch) = 0;
@@ -71,6 +74,15 @@ protected:
 
 private:
 
+    enum {
+        WakeRetracts  = 1 << 0,
+        WakePublishes = 1 << 1,
+        WakeDiscovers = 1 << 2,
+        WakeForgets   = 1 << 3,
+        WakeLosts     = 1 << 4,
+    };
+    Wakeup wakeup;
+
     enum { QueueSize = 1 << 4 };
     Defer<QueueSize, std::string> retracts;
     Defer<QueueSize, std::string, Payload> publishes;
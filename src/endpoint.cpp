@@ -10,57 +10,199 @@
 #include "lockless/tls.h"
 
 #include <cassert>
+#include <cstring>
+#include <climits>
+#include <cmath>
+#include <algorithm>
+#include <sys/poll.h>
+#include <unistd.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 
 namespace slick {
 
+/******************************************************************************/
+/* POLL TAGS                                                                  */
+/******************************************************************************/
+
+/** Connections are registered with epoll using a pointer to their state which
+    means that an event can be dispatched without any lookups. Everything else
+    is registered with a pointer to its PollSource tagged in the low bit which
+    can never be set on either pointer.
+ */
+
+namespace {
+
+uint64_t sourceTag(PollSource& source) { return uint64_t(&source) | 1; }
+bool isSourceTag(uint64_t data) { return data & 1; }
+
+PollSource& tagSource(uint64_t data)
+{
+    return *reinterpret_cast<PollSource*>(data & ~uint64_t(1));
+}
+
+} // namespace anonymous
+
+
+/******************************************************************************/
+/* URING TAGS                                                                 */
+/******************************************************************************/
+
+/** Completions carry the operation in the low bits of their user data. Writes
+    point straight at their UringWrite which is always suitably aligned while
+    everything else packs the fd along with the generation of the connection
+    which is how completions for a closed connection are weeded out once its
+    fd has been reused.
+ */
+
+namespace {
+
+enum UringOp
+{
+    OpBuffers  = 0,
+    OpAccept   = 1,
+    OpRecv     = 2,
+    OpWritable = 3,
+    OpSend     = 4,
+    OpCancel   = 5,
+
+    OpBits = 3,
+    OpMask = (1 << OpBits) - 1,
+};
+
+// Generations have to fit in what's left of the user data.
+enum { GenShift = 35, GenMask = (1U << (64 - GenShift)) - 1 };
+
+uint64_t opTag(UringOp op, int fd, uint32_t gen = 0)
+{
+    return op | uint64_t(uint32_t(fd)) << OpBits | uint64_t(gen) << GenShift;
+}
+
+uint64_t opTag(UringOp op, const void* ptr)
+{
+    assert(!(uint64_t(ptr) & OpMask));
+    return op | uint64_t(ptr);
+}
+
+UringOp tagOp(uint64_t data) { return UringOp(data & OpMask); }
+int tagOpFd(uint64_t data) { return uint32_t(data >> OpBits); }
+uint32_t tagOpGen(uint64_t data) { return data >> GenShift; }
+
+template<typename T>
+T* tagOpPtr(uint64_t data)
+{
+    return reinterpret_cast<T*>(data & ~uint64_t(OpMask));
+}
+
+struct FlagGuard
+{
+    explicit FlagGuard(bool& flag) : flag(flag) { flag = true; }
+    ~FlagGuard() { flag = false; }
+
+private:
+    bool& flag;
+};
+
+} // namespace anonymous
+
+
 /******************************************************************************/
 /* ENDPOINT BASE                                                              */
 /******************************************************************************/
 
 Endpoint::
-Endpoint()
+Endpoint(Backend backend) :
+    chunkThreshold_(DefaultChunkThreshold),
+    maxPayloadSize_(DefaultMaxPayloadSize),
+    readBudget_(DefaultReadBudget),
+    pendingLow_(0), pendingHigh_(0),
+    creditWindow_(0), spinBudget_(0),
+    endpointQueueLimits_(QueueLimits::unlimited()),
+    queuedBytes_(0), throttled(false),
+    sweepTick(0), idleTicks(0), readTicks(0), heartbeatTicks(0),
+    heartbeat(0),
+    ringOps(0), acceptOps(0), nextGen(1), reaping(false),
+    sends(wakeup, WakeSends),
+    multicasts(wakeup, WakeMulticasts),
+    broadcasts(wakeup, WakeBroadcasts),
+    connects(wakeup, WakeConnects),
+    disconnects(wakeup, WakeDisconnects),
+    readControls(wakeup, WakeReadControls),
+    consumes(wakeup, WakeConsumes)
 {
-    init();
+    init(backend);
 }
 
 Endpoint::
-Endpoint(Port listenPort)
+Endpoint(Port listenPort, bool reusePort, Backend backend) :
+    chunkThreshold_(DefaultChunkThreshold),
+    maxPayloadSize_(DefaultMaxPayloadSize),
+    readBudget_(DefaultReadBudget),
+    pendingLow_(0), pendingHigh_(0),
+    creditWindow_(0), spinBudget_(0),
+    endpointQueueLimits_(QueueLimits::unlimited()),
+    queuedBytes_(0), throttled(false),
+    sweepTick(0), idleTicks(0), readTicks(0), heartbeatTicks(0),
+    heartbeat(0),
+    ringOps(0), acceptOps(0), nextGen(1), reaping(false),
+    sends(wakeup, WakeSends),
+    multicasts(wakeup, WakeMulticasts),
+    broadcasts(wakeup, WakeBroadcasts),
+    connects(wakeup, WakeConnects),
+    disconnects(wakeup, WakeDisconnects),
+    readControls(wakeup, WakeReadControls),
+    consumes(wakeup, WakeConsumes)
 {
-    init();
-
-    listenSockets = PassiveSockets(listenPort);
-    for (int fd : listenSockets.fds())
-        poller.add(fd, EPOLLET | EPOLLIN);
+    init(backend);
+    listen(listenPort, reusePort);
 }
 
 void
 Endpoint::
-init()
+init(Backend backend)
 {
     using namespace std::placeholders;
 
-    poller.add(disconnectQueueFd.fd());
+    if (backend == Backend::Uring) {
+        ring.reset(new IoUring);
+        ringBuffers.reset(new UringBuffers(*ring, 0));
+
+        ringSource = PollSource(ring->fd(), this, [] (void* self, int, uint32_t) {
+                    static_cast<Endpoint*>(self)->reap();
+                });
+        poller.add(ring->fd(), sourceTag(ringSource), EPOLLIN);
+    }
+
+    wakeupSource = PollSource(wakeup.fd(), this, [] (void* self, int, uint32_t) {
+                auto& endpoint = *static_cast<Endpoint*>(self);
+                endpoint.pollDeferred(endpoint.wakeup.poll(), DeferCap);
+            });
+    poller.add(wakeup.fd(), sourceTag(wakeupSource), EPOLLIN);
+
+    sweepTimer.onTimer = std::bind(&Endpoint::sweep, this, _1);
+    sweepSource = PollSource(sweepTimer.fd(), this, [] (void* self, int, uint32_t) {
+                static_cast<Endpoint*>(self)->sweepTimer.poll();
+            });
+    poller.add(sweepTimer.fd(), sourceTag(sweepSource), EPOLLIN);
 
     typedef void (Endpoint::*SendFn) (int, Payload&&);
     sends.onOperation = std::bind((SendFn)&Endpoint::send, this, _1, _2);
-    poller.add(sends.fd());
 
     typedef void (Endpoint::*MulticastFn) (const SortedVector<int>&, Payload&&);
     multicasts.onOperation = std::bind((MulticastFn)&Endpoint::multicast, this, _1, _2);
-    poller.add(multicasts.fd());
 
     typedef void (Endpoint::*BroadcastFn) (Payload&&);
     broadcasts.onOperation = std::bind((BroadcastFn)&Endpoint::broadcast, this, _1);
-    poller.add(broadcasts.fd());
 
     typedef void (Endpoint::*ConnectFn) (Socket&&);
     connects.onOperation = std::bind((ConnectFn)&Endpoint::connect, this, _1);
-    poller.add(connects.fd());
 
     typedef void (Endpoint::*DisconnectFn) (int);
     disconnects.onOperation = std::bind((DisconnectFn)&Endpoint::doDisconnect, this, _1);
-    poller.add(disconnects.fd());
+
+    readControls.onOperation = std::bind(&Endpoint::doPauseReads, this, _1, _2);
+    consumes.onOperation = std::bind(&Endpoint::doConsumed, this, _1, _2);
 
     onError = [=] (int, int errnum) {
         if (errnum == ECONNRESET || errnum == EPIPE) return true;
@@ -77,14 +219,23 @@ Endpoint::
     // The extra step is required to not invalidate our iterator
     std::vector<int> toDisconnect;
     for (const auto& connection : connections)
-        toDisconnect.push_back(connection.first);
+        if (connection.socket) toDisconnect.push_back(connection.socket.fd());
 
     doDisconnect(std::move(disconnectQueue));
     for (int fd : toDisconnect)
         doDisconnect(fd);
 
-    for (int fd : listenSockets.fds())
-        poller.del(fd);
+    if (!ring) {
+        for (int fd : listenSockets.fds())
+            poller.del(fd);
+        return;
+    }
+
+    // The kernel may still be reading or writing into memory we own so we
+    // have to wait for every operation to wind down before going away.
+    listenSockets = PassiveSockets();
+    cancel(-1);
+    while (ringOps) dispatch(ring->next());
 }
 
 void
@@ -93,11 +244,30 @@ stopPolling()
 {
     ThreadAwarePollable::stopPolling();
 
-    doDisconnect(std::move(disconnectQueue));
-    sends.poll();
-    broadcasts.poll();
-    connects.poll();
-    disconnects.poll();;
+    // Producers may have pushed without having raised their bit yet so every
+    // queue is drained regardless of the mask.
+    wakeup.poll();
+    pollDeferred(~uint64_t(0), 0);
+}
+
+void
+Endpoint::
+pollDeferred(uint64_t ready, size_t cap)
+{
+    // Connects are drained first and in full so that a send that follows a
+    // connect from the same thread finds its connection. Anything pushed
+    // after the connects have been drained also raised its bit after the
+    // mask was read so it'll wait for the next round.
+    if (ready & WakeConnects)        connects.poll();
+
+    if (ready & WakeDisconnectQueue) doDisconnect(std::move(disconnectQueue));
+    if (ready & WakeSends)           sends.poll(cap);
+    if (ready & WakeMulticasts)      multicasts.poll(cap);
+    if (ready & WakeBroadcasts)      broadcasts.poll(cap);
+    if (ready & WakeDisconnects)     disconnects.poll(cap);
+    if (ready & WakeReadControls)    readControls.poll(cap);
+    if (ready & WakeConsumes)        consumes.poll(cap);
+    if (ready & WakeReads)           pollReads();
 }
 
 template<typename Payload>
@@ -123,45 +293,63 @@ poll(int timeoutMs)
 
         struct epoll_event ev = poller.next();
 
-        if (connections.count(ev.data.fd)) {
+        if (!isSourceTag(ev.data.u64)) {
+            auto& conn = *static_cast<ConnectionState*>(ev.data.ptr);
 
-            if (ev.events & EPOLLERR) {
-                auto& conn = connections[ev.data.fd];
+            // Connection was closed by an earlier event of the same batch.
+            if (!conn.socket) continue;
 
+            if (ev.events & EPOLLERR) {
                 int err = conn.socket.error();
 
                 if (!err) continue;
-                else if (!onError || onError(ev.data.fd, err))
-                    disconnect(ev.data.fd);
+                else if (!onError || onError(conn.socket.fd(), err))
+                    disconnect(conn.socket.fd());
             }
 
-            if (ev.events & EPOLLOUT) flushQueue(ev.data.fd);
-            if (ev.events & EPOLLIN) recvPayload(ev.data.fd);
+            if (ev.events & EPOLLOUT) flushQueue(conn);
+            if (ev.events & EPOLLIN) recvPayload(conn);
+            continue;
         }
 
-        else if (listenSockets.test(ev.data.fd)) accept(ev.data.fd);
-
-        else if (ev.data.fd == disconnectQueueFd.fd())
-            doDisconnect(std::move(disconnectQueue));
-
-        else if (ev.data.fd == sends.fd())       sends.poll(DeferCap);
-        else if (ev.data.fd == broadcasts.fd())  broadcasts.poll(DeferCap);
-        else if (ev.data.fd == connects.fd())    connects.poll(DeferCap);
-        else if (ev.data.fd == disconnects.fd()) disconnects.poll(DeferCap);
-
-        else assert(false);
+        tagSource(ev.data.u64)(ev.events);
+        if (ring) ring->submit();
     }
 }
 
 
 void
 Endpoint::
-listen(Port listenPort)
+listen(Port listenPort, bool reusePort)
 {
     assert(!isPollThread.isPolling());
 
-    for (int fd : listenSockets.fds()) poller.del(fd);
-    listenSockets = PassiveSockets(listenPort);
+    if (!ring) {
+        for (int fd : listenSockets.fds()) poller.del(fd);
+    }
+    else {
+        // Multishot accepts must be stopped before the fds can be reused.
+        for (int fd : listenSockets.fds()) cancel(fd);
+        while (acceptOps) dispatch(ring->next());
+    }
+
+    listenSockets = PassiveSockets(listenPort, reusePort);
+
+    if (ring) {
+        for (int fd : listenSockets.fds()) armAccept(fd);
+        return;
+    }
+
+    // Sized up front so that the registered sources never move.
+    listenSources.clear();
+    listenSources.reserve(listenSockets.fds().size());
+
+    for (int fd : listenSockets.fds()) {
+        listenSources.emplace_back(fd, this, [] (void* self, int fd, uint32_t) {
+                    static_cast<Endpoint*>(self)->accept(fd);
+                });
+        poller.add(fd, sourceTag(listenSources.back()), EPOLLET | EPOLLIN);
+    }
 }
 
 void
@@ -183,14 +371,35 @@ connect(Socket&& socket)
     }
 
     int fd = socket.fd();
-    poller.add(fd, EPOLLET | EPOLLIN | EPOLLOUT);
+    assert(fd >= 0);
+
+    // Growing a deque at the back never invalidates references to existing
+    // connections which keeps the pointers registered with epoll valid.
+    if (size_t(fd) >= connections.size()) connections.resize(fd + 1);
+
+    auto& conn = connections[fd];
+    assert(!conn.socket);
+
+    conn = ConnectionState();
+    conn.socket = std::move(socket);
+    if (spinBudget_) conn.socket.busyPoll(spinBudget_);
+    conn.queueLimits = queueLimits_;
+    conn.lastRecv = conn.lastSent = conn.lastActive = sweepTick;
 
-    auto it = connections.find(fd);
-    assert(it == connections.end());
+    if (!ring) poller.add(fd, uint64_t(&conn), EPOLLET | EPOLLIN | EPOLLOUT);
 
-    ConnectionState connection;
-    connection.socket = std::move(socket);
-    connections[fd] = std::move(connection);
+    else {
+        conn.gen = nextGen;
+        nextGen = (nextGen + 1) & GenMask;
+
+        conn.uringWrite.reset(new UringWrite(&conn));
+        armRecv(conn);
+        armWrite(conn);
+    }
+
+    // Queued up until the connection is established which has to come after
+    // the first write is armed as that's how io_uring finds out about it.
+    if (creditWindow_) grantCredits(conn, creditWindow_);
 }
 
 int
@@ -231,21 +440,19 @@ disconnect(int fd)
         return;
     }
 
-    auto it = connections.find(fd);
-    if (it == connections.end() || !it->second.connected || it->second.disconnected)
-        return;
+    auto conn = connection(fd);
+    if (!conn || !conn->connected || conn->disconnected) return;
 
-    it->second.disconnected = true;
+    conn->disconnected = true;
 
     disconnectQueue.emplace_back(fd);
-    disconnectQueueFd.signal();
+    wakeup.signal(WakeDisconnectQueue);
 }
 
 void
 Endpoint::
 doDisconnect(std::vector<int> fds)
 {
-    while (disconnectQueueFd.poll());
     for (int fd : fds) doDisconnect(fd);
 }
 
@@ -253,64 +460,85 @@ void
 Endpoint::
 doDisconnect(int fd)
 {
-    auto it = connections.find(fd);
-    assert(it != connections.end());
+    auto conn = connection(fd);
+    assert(conn);
 
     if (onDroppedPayload) {
-        for (auto& pl : it->second.sendQueue)
+        for (auto& pl : conn->sendQueue)
             dropPayload(fd, std::move(pl.first));
+        for (auto& pl : conn->creditQueue)
+            dropPayload(fd, std::move(pl));
     }
 
-    poller.del(fd);
-    connections.erase(fd);
+    queuedBytes_ -= conn->queuedBytes;
+
+    if (!ring) poller.del(fd);
+
+    // Closing the socket shuts it down which winds down any operation still
+    // in flight on it.
+    else if (conn->uringWrite->inFlight) {
+        conn->uringWrite->conn = nullptr;
+        retiredWrites.emplace_back(std::move(conn->uringWrite));
+    }
+
+    *conn = ConnectionState();
+
+    if (throttled && queuedBytes_ <= endpointQueueLimits_.lowWatermark) {
+        throttled = false;
+        if (onLowWatermark) onLowWatermark(-1);
+    }
 
     if (onLostConnection) onLostConnection(fd);
 }
 
 
-uint8_t*
+Endpoint::ConnectionState*
 Endpoint::
-processRecvBuffer(uint8_t* first, uint8_t* last, std::vector<Payload>& queue)
+connection(int fd)
 {
-    uint8_t* it = first;
-
-    while (it < last) {
-        size_t leftover = last - it;
-        Payload data = Payload::read(it, leftover);
-
-        if (!data.packetSize()) {
-            std::copy(it, last, first);
-            return first + leftover;
-        }
+    if (fd < 0 || size_t(fd) >= connections.size()) return nullptr;
 
-        it += data.packetSize();
-        assert(data.packetSize());
-        queue.emplace_back(std::move(data));
-    }
+    auto& conn = connections[fd];
+    return conn.socket ? &conn : nullptr;
+}
 
-    assert(it == last);
-    return first;
+const Endpoint::ConnectionState*
+Endpoint::
+connection(int fd) const
+{
+    return const_cast<Endpoint*>(this)->connection(fd);
 }
 
+
 void
 Endpoint::
-recvPayload(int fd)
+recvPayload(ConnectionState& conn)
 {
-    auto connIt = connections.find(fd);
-    if (connIt == connections.end()) return;
-    auto& conn = connIt->second;
+    // Events that were part of the batch that paused the connection.
+    if (conn.readsOff) return;
 
-    enum { bufferLength = 1U << 16 };
-    uint8_t buffer[bufferLength];
-    uint8_t* bufferIt = buffer;
+    int fd = conn.socket.fd();
+    auto& buffer = conn.recvBuffer;
 
-    std::vector<Payload> queue;
-    queue.reserve(1 << 5);
+    // Callbacks could end up reading from another connection so the queue is
+    // borrowed instead of being used in place.
+    std::vector<Payload> queue = std::move(recvQueue);
 
     bool doDisconnect = false;
+    size_t bytesRead = 0;
 
     while (true) {
-        ssize_t read = recv(fd, bufferIt, (buffer + bufferLength) - bufferIt, 0);
+        if (readBudget_ && bytesRead >= readBudget_) {
+            queueRead(conn);
+            break;
+        }
+
+        uint8_t* it = buffer.prepare();
+
+        size_t size = buffer.available();
+        if (readBudget_) size = std::min(size, readBudget_ - bytesRead);
+
+        ssize_t read = recv(fd, it, size, 0);
 
         if (read < 0) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) break;
@@ -324,185 +552,1176 @@ recvPayload(int fd)
         }
 
         conn.bytesRecv += read;
-        bufferIt = processRecvBuffer(buffer, bufferIt + read, queue);
-        assert(bufferIt < (buffer + bufferLength));
+        bytesRead += read;
+        buffer.commit(read);
+
+        if (!readFrames(conn, queue)) {
+            doDisconnect = true;
+            break;
+        }
     }
 
-    for (auto& data : queue)
-        onPayload(fd, std::move(data));
+    deliver(fd, queue);
+    recvQueue = std::move(queue);
 
-    if (doDisconnect && connections.count(fd))
+    if (doDisconnect && connection(fd))
         disconnect(fd);
 }
 
-
-template<typename Payload>
+/** Gives every connection in the ready list another turn. The edge for their
+    data has already fired so nothing else will bring us back to them.
+    Connections that go over their budget again are queued up behind the
+    current round.
+ */
 void
 Endpoint::
-pushToSendQueue(Endpoint::ConnectionState& conn, Payload&& data, size_t offset)
+pollReads()
 {
-    enum { MaxQueueSize = 1 << 8 };
+    for (size_t n = readyReads.size(); n; --n) {
+        int fd = readyReads.front();
+        readyReads.pop_front();
 
-    if (conn.sendQueue.size() < MaxQueueSize)
-        conn.sendQueue.emplace_back(std::forward<Payload>(data), offset);
+        // Could have been closed or even replaced by a new connection.
+        auto conn = connection(fd);
+        if (!conn || !conn->readReady) continue;
 
-    else dropPayload(conn.socket.fd(), std::forward<Payload>(data));
+        conn->readReady = false;
+        if (ring) recvStash(*conn);
+        else recvPayload(*conn);
+    }
 }
 
-template<typename Payload>
-bool
+void
 Endpoint::
-sendTo(Endpoint::ConnectionState& conn, Payload&& data, size_t offset)
+queueRead(ConnectionState& conn)
 {
-    if (conn.disconnected) {
-        dropPayload(conn.socket.fd(), std::forward<Payload>(data));
-        return true;
-    }
-
-    if (!conn.writable) {
-        pushToSendQueue(conn, std::forward<Payload>(data), 0);
-        return true;
-    }
+    if (conn.readReady) return;
 
-    const uint8_t* start = data.packet() + offset;
-    ssize_t size = data.packetSize() - offset;
-    assert(size > 0);
+    conn.readReady = true;
+    readyReads.push_back(conn.socket.fd());
+    wakeup.signal(WakeReads);
+}
 
-    while (true) {
+/** Pulls every complete frame out of the receive buffer. Chunks point into the
+    buffer so they're handed out right away which means that whatever was
+    queued ahead of them has to be flushed first to preserve the ordering.
 
-        ssize_t sent = ::send(conn.socket.fd(), start, size, MSG_NOSIGNAL);
-        assert(sent); // No idea what to do with a return value of 0.
+    Returns false if the next frame is larger then we're willing to buffer.
+ */
+bool
+Endpoint::
+readFrames(ConnectionState& conn, std::vector<Payload>& queue)
+{
+    int fd = conn.socket.fd();
+    auto& buffer = conn.recvBuffer;
 
-        if (sent > 0) conn.bytesSent += sent;
+    buffer.streamThreshold(onPayloadChunk ? chunkThreshold_ : 0);
+    conn.lastRecv = sweepTick;
 
-        if (sent == size) return true;
-        if (sent >= 0 && sent < size) {
-            start += sent;
-            size -= sent;
-            assert(size > 0);
+    while (true) {
+        if (Payload data = buffer.next()) {
+            if (data.isControl()) onControl(conn, data);
+            else if (data.size()) { // otherwise a heartbeat
+                conn.lastActive = sweepTick;
+                queue.emplace_back(std::move(data));
+            }
             continue;
         }
 
-        // sent < 0
+        PayloadChunk chunk = buffer.nextChunk();
+        if (!chunk) break;
 
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            conn.writable = false;
+        conn.lastActive = sweepTick;
+        deliver(fd, queue);
+        onPayloadChunk(fd, chunk);
 
-            size_t pos = data.packetSize() - size;
-            pushToSendQueue(conn, std::forward<Payload>(data), pos);
-            return true;
+        // Chunks are gone as soon as the callback returns.
+        if (creditWindow_) grantCredits(conn, chunk.size);
+    }
+
+    return buffer.nextSize() <= maxPayloadSize_;
+}
+
+void
+Endpoint::
+deliver(int fd, std::vector<Payload>& queue)
+{
+    if (queue.empty()) return;
+
+    // Accounted for ahead of the callbacks which can consume right away.
+    auto conn = connection(fd);
+    if (conn && (pendingHigh_ || creditWindow_)) {
+        size_t bytes = 0;
+        for (const auto& data : queue) bytes += data.size();
+
+        if (!pendingHigh_) grantCredits(*conn, bytes);
+
+        else {
+            conn->pendingBytes += bytes;
+
+            if (!conn->readLimited && conn->pendingBytes > pendingHigh_) {
+                conn->readLimited = true;
+                updateReads(*conn);
+            }
         }
+    }
 
-        else if (errno == ECONNRESET || errno == EPIPE) return false;
-        SLICK_CHECK_ERRNO(sent >= 0, "Endpoint.sendTo.send");
+    if (onPayloadBatch)
+        onPayloadBatch(fd, PayloadSpan(queue.data(), queue.size()));
+
+    else {
+        for (auto& data : queue)
+            onPayload(fd, std::move(data));
     }
+
+    queue.clear();
 }
 
 
 void
 Endpoint::
-send(int fd, Payload&& data)
+queueLimits(const QueueLimits& limits)
 {
-    if (!isPollThread()) {
-        // \todo Need a way to avoid this copy.
-        if (!sends.tryDefer(fd, data))
-            dropPayload(fd, std::move(data));
-        return;
-    }
+    assert(!isPollThread.isPolling());
+    queueLimits_ = limits;
+}
 
-    auto it = connections.find(fd);
+void
+Endpoint::
+queueLimits(int fd, const QueueLimits& limits)
+{
+    assert(isPollThread());
 
-    if (it == connections.end()) {
-        dropPayload(fd, std::move(data));
-        return;
-    }
+    auto conn = connection(fd);
+    if (!conn) return;
 
-    if (!sendTo(it->second, std::move(data))) {
-        dropPayload(fd, std::move(data));
-        disconnect(it->first);
-    }
+    conn->queueLimits = limits;
+    checkWatermarks(*conn);
 }
 
 void
 Endpoint::
-multicast(const SortedVector<int>& fds, Payload&& data)
+endpointQueueLimits(const QueueLimits& limits)
 {
-    if (fds.size() == 1) {
-        send(fds.front(), std::move(data));
-        return;
-    }
+    assert(!isPollThread.isPolling());
+    endpointQueueLimits_ = limits;
+}
 
-    if (!isPollThread()) {
-        if (!multicasts.tryDefer(fds, data)) {
-            for (int fd : fds)
-                dropPayload(fd, std::move(data));
-        }
-        return;
-    }
+void
+Endpoint::
+chunkThreshold(size_t bytes)
+{
+    assert(!isPollThread.isPolling());
+    chunkThreshold_ = bytes;
+}
 
-    for (int fd : fds) {
-        auto it = connections.find(fd);
+void
+Endpoint::
+maxPayloadSize(size_t bytes)
+{
+    assert(!isPollThread.isPolling());
+    maxPayloadSize_ = bytes;
+}
 
-        if (it == connections.end()) {
-            dropPayload(fd, data);
-            continue;
-        }
+void
+Endpoint::
+readBudget(size_t bytes)
+{
+    assert(!isPollThread.isPolling());
+    readBudget_ = bytes;
+}
 
-        if (!sendTo(it->second, data)) {
-            dropPayload(fd, data);
-            disconnect(fd);
-        }
-    }
+void
+Endpoint::
+pendingLimits(size_t low, size_t high)
+{
+    assert(!isPollThread.isPolling());
+    assert(low <= high);
+
+    pendingLow_ = low;
+    pendingHigh_ = high;
+}
+
+size_t
+Endpoint::
+pendingBytes(int fd) const
+{
+    assert(isPollThread());
+
+    auto conn = connection(fd);
+    return conn ? conn->pendingBytes : 0;
 }
 
 void
 Endpoint::
-broadcast(Payload&& data)
+pauseReads(int fd)
 {
-    if (!isPollThread()) {
-        if (!broadcasts.tryDefer(data))
-            dropPayload(-1, std::move(data));
-        return;
-    }
+    if (!isPollThread()) readControls.defer(fd, true);
+    else doPauseReads(fd, true);
+}
 
-    for (auto& conn : connections) {
-        if (!sendTo(conn.second, data)) {
-            dropPayload(conn.first, data);
-            disconnect(conn.second.socket.fd());
-        }
-    }
+void
+Endpoint::
+resumeReads(int fd)
+{
+    if (!isPollThread()) readControls.defer(fd, false);
+    else doPauseReads(fd, false);
+}
+
+void
+Endpoint::
+doPauseReads(int fd, bool pause)
+{
+    auto conn = connection(fd);
+    if (!conn) return;
+
+    conn->readPaused = pause;
+    updateReads(*conn);
 }
 
+void
+Endpoint::
+consumed(int fd, size_t bytes)
+{
+    if (!isPollThread()) consumes.defer(fd, bytes);
+    else doConsumed(fd, bytes);
+}
 
 void
 Endpoint::
-flushQueue(int fd)
+doConsumed(int fd, size_t bytes)
 {
-    auto it = connections.find(fd);
-    if (it == connections.end()) return;
+    auto conn = connection(fd);
+    if (!conn) return;
 
-    auto& conn = it->second;
+    bytes = std::min(bytes, conn->pendingBytes);
+    conn->pendingBytes -= bytes;
+    if (creditWindow_) grantCredits(*conn, bytes);
 
-    if (!conn.connected) {
-        if (onNewConnection) onNewConnection(conn.socket.fd());
-        conn.connected = true;
+    if (conn->readLimited && conn->pendingBytes <= pendingLow_) {
+        conn->readLimited = false;
+        updateReads(*conn);
     }
-    conn.writable = true;
+}
 
-    auto queue = std::move(conn.sendQueue);
+/** Epoll stops reporting reads by dropping EPOLLIN from the interest set while
+    io_uring has its multishot recv cancelled. Either way whatever came in while
+    paused is picked up by queuing a read on resume since no new edge or
+    completion is guaranteed to show up for it.
+ */
+void
+Endpoint::
+updateReads(ConnectionState& conn)
+{
+    bool off = conn.readPaused || conn.readLimited;
+    if (off == conn.readsOff) return;
+    conn.readsOff = off;
 
-    size_t i = 0;
-    for (i = 0; i < queue.size(); ++i) {
-        if (!sendTo(conn, std::move(queue[i].first), queue[i].second))
-            break;
+    int fd = conn.socket.fd();
+
+    if (!ring) {
+        int flags = EPOLLET | EPOLLOUT | (off ? 0 : int(EPOLLIN));
+        poller.mod(fd, uint64_t(&conn), flags);
     }
 
-    if (i == queue.size()) return;
+    else if (off) {
+        struct io_uring_sqe* sqe = ring->sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = opTag(OpRecv, fd, conn.gen);
+        sqe->user_data = opTag(OpCancel, fd);
 
-    for (; i < queue.size(); ++i)
-        dropPayload(fd, std::move(queue[i].first));
+        ringOps++;
+        submit();
+    }
 
-    disconnect(fd);
+    // The cancelled recv re-arms itself on completion if we've been resumed
+    // in the meantime.
+    else if (!conn.recvArmed) armRecv(conn);
+
+    if (!off) queueRead(conn);
+}
+
+void
+Endpoint::
+creditWindow(size_t bytes)
+{
+    assert(!isPollThread.isPolling());
+    creditWindow_ = bytes;
+}
+
+void
+Endpoint::
+spin(size_t budgetUs)
+{
+    assert(!isPollThread.isPolling());
+    spinBudget_ = budgetUs;
+    poller.spin(budgetUs);
+}
+
+void
+Endpoint::
+maxEvents(size_t events)
+{
+    assert(!isPollThread.isPolling());
+    poller.maxEvents(events);
+}
+
+auto
+Endpoint::
+creditStats(int fd) const -> CreditStats
+{
+    assert(isPollThread());
+
+    CreditStats stats;
+    std::memset(&stats, 0, sizeof stats);
+
+    auto conn = connection(fd);
+    if (!conn) return stats;
+
+    stats = conn->creditStats;
+    stats.credits = conn->credits;
+    stats.heldPayloads = conn->creditQueue.size();
+    for (const auto& data : conn->creditQueue)
+        stats.heldBytes += data.packetSize();
+
+    return stats;
+}
+
+/** Grants are batched up until they reach half the window so that the other
+    side isn't sent a control frame for every payload we receive.
+ */
+void
+Endpoint::
+grantCredits(ConnectionState& conn, size_t bytes)
+{
+    conn.creditsOwed += bytes;
+    if (conn.creditsOwed < creditWindow_ / 2) return;
+
+    uint64_t grant = conn.creditsOwed;
+    conn.creditsOwed = 0;
+    conn.creditStats.granted += grant;
+
+    Payload data = Payload::control(sizeof grant);
+    std::memcpy(data.begin(), &grant, sizeof grant);
+
+    if (!sendTo(conn, std::move(data)))
+        disconnect(conn.socket.fd());
+}
+
+void
+Endpoint::
+onControl(ConnectionState& conn, const Payload& data)
+{
+    // Unknown control frames are ignored so that they can be extended.
+    uint64_t grant;
+    if (data.size() != sizeof grant) return;
+
+    std::memcpy(&grant, data.bytes(), sizeof grant);
+    conn.credits += grant;
+    conn.creditStats.received += grant;
+
+    releaseCredits(conn);
+}
+
+void
+Endpoint::
+releaseCredits(ConnectionState& conn)
+{
+    auto& queue = conn.creditQueue;
+    if (queue.empty()) return;
+
+    int fd = conn.socket.fd();
+    FlagGuard guard(conn.releasing);
+
+    while (!queue.empty() && conn.credits > 0) {
+        Payload data = std::move(queue.front());
+        queue.pop_front();
+
+        size_t bytes = data.packetSize();
+        conn.queuedBytes -= bytes;
+        queuedBytes_ -= bytes;
+        conn.credits -= data.size();
+
+        if (!sendTo(conn, std::move(data))) {
+            dropPayload(fd, std::move(data));
+            disconnect(fd);
+            return;
+        }
+    }
+
+    checkWatermarks(conn);
+}
+
+void
+Endpoint::
+timeouts(const Timeouts& timeouts)
+{
+    assert(!isPollThread.isPolling());
+
+    double period = 0;
+    for (double value : { timeouts.idle, timeouts.read, timeouts.heartbeat }) {
+        assert(value >= 0);
+        if (value && (!period || value < period)) period = value;
+    }
+
+    period /= 4;
+    sweepTimer.setDelay(period);
+    if (!period) return;
+
+    auto toTicks = [=] (double value) -> uint64_t {
+        return value ? std::ceil(value / period) : 0;
+    };
+
+    idleTicks = toTicks(timeouts.idle);
+    readTicks = toTicks(timeouts.read);
+    heartbeatTicks = toTicks(timeouts.heartbeat);
+}
+
+/** A single timer for every connection means that we don't need to touch a
+    timer whenever there's activity on a connection. Connections just stamp
+    the current tick which is compared with the timeouts here.
+ */
+void
+Endpoint::
+sweep(uint64_t ticks)
+{
+    sweepTick += ticks;
+
+    // Indexing instead of iterating because a callback could grow the table.
+    for (size_t fd = 0; fd < connections.size(); ++fd) {
+        auto& conn = connections[fd];
+        if (!conn.socket || conn.disconnected) continue;
+
+        // We're the ones not reading from a paused connection.
+        if (conn.readsOff) conn.lastRecv = sweepTick;
+
+        if (readTicks && sweepTick - conn.lastRecv >= readTicks)
+            disconnect(fd);
+
+        else if (idleTicks && sweepTick - conn.lastActive >= idleTicks)
+            disconnect(fd);
+
+        // A backed up queue will get to the other side soon enough.
+        else if (heartbeatTicks && sweepTick - conn.lastSent >= heartbeatTicks) {
+            if (conn.sendQueue.empty() && !sendTo(conn, heartbeat))
+                disconnect(fd);
+        }
+    }
+}
+
+size_t
+Endpoint::
+queuedBytes(int fd) const
+{
+    auto conn = connection(fd);
+    return conn ? conn->queuedBytes : 0;
+}
+
+void
+Endpoint::
+checkWatermarks(ConnectionState& conn)
+{
+    const auto& limits = conn.queueLimits;
+
+    if (!conn.throttled && conn.queuedBytes >= limits.highWatermark) {
+        conn.throttled = true;
+        if (onHighWatermark) onHighWatermark(conn.socket.fd());
+    }
+    else if (conn.throttled && conn.queuedBytes <= limits.lowWatermark) {
+        conn.throttled = false;
+        if (onLowWatermark) onLowWatermark(conn.socket.fd());
+    }
+
+    const auto& endpointLimits = endpointQueueLimits_;
+
+    if (!throttled && queuedBytes_ >= endpointLimits.highWatermark) {
+        throttled = true;
+        if (onHighWatermark) onHighWatermark(-1);
+    }
+    else if (throttled && queuedBytes_ <= endpointLimits.lowWatermark) {
+        throttled = false;
+        if (onLowWatermark) onLowWatermark(-1);
+    }
+}
+
+template<typename Payload>
+void
+Endpoint::
+pushToSendQueue(Endpoint::ConnectionState& conn, Payload&& data, size_t offset)
+{
+    size_t bytes = data.packetSize() - offset;
+
+    // The head of a partly sent frame is already on the wire so dropping the
+    // rest would leave the peer misparsing everything that follows. It's
+    // queued regardless of the limits which can only be exceeded by a single
+    // payload this way.
+    bool overLimit =
+        conn.queuedBytes + bytes > conn.queueLimits.maxBytes ||
+        queuedBytes_ + bytes > endpointQueueLimits_.maxBytes;
+
+    if (!offset && overLimit) {
+        dropPayload(conn.socket.fd(), std::forward<Payload>(data));
+        return;
+    }
+
+    // Lvalue payloads from multicast and broadcast are shared and not copied
+    // so queuing them on any number of slow connections is cheap.
+    conn.sendQueue.emplace_back(std::forward<Payload>(data), offset);
+
+    conn.queuedBytes += bytes;
+    queuedBytes_ += bytes;
+
+    checkWatermarks(conn);
+}
+
+template<typename Payload>
+bool
+Endpoint::
+sendTo(Endpoint::ConnectionState& conn, Payload&& data)
+{
+    conn.lastSent = sweepTick;
+
+    bool control = data.isControl() || !data.size();
+    if (!control) conn.lastActive = sweepTick;
+
+    if (conn.disconnected) {
+        dropPayload(conn.socket.fd(), std::forward<Payload>(data));
+        return true;
+    }
+
+    // Anything already held back has dibs on the credits.
+    if (creditWindow_ && !control && !conn.releasing) {
+        if (conn.credits <= 0 || !conn.creditQueue.empty()) {
+            size_t bytes = data.packetSize();
+            conn.queuedBytes += bytes;
+            queuedBytes_ += bytes;
+
+            conn.creditQueue.emplace_back(std::forward<Payload>(data));
+            conn.creditStats.stalls++;
+
+            checkWatermarks(conn);
+            return true;
+        }
+
+        conn.credits -= data.size();
+    }
+
+    if (!conn.writable) {
+        pushToSendQueue(conn, std::forward<Payload>(data), 0);
+        return true;
+    }
+
+    // Preserves the ordering with whatever is still sitting in the queue. The
+    // payload is owned by the queue at this point so a lost connection has to
+    // be handled here and the queue will be dropped by the disconnect.
+    if (!conn.sendQueue.empty()) {
+        pushToSendQueue(conn, std::forward<Payload>(data), 0);
+
+        if (flushSendQueue(conn)) checkWatermarks(conn);
+        else disconnect(conn.socket.fd());
+
+        return true;
+    }
+
+    const uint8_t* start = data.packet();
+    ssize_t size = data.packetSize();
+    assert(size > 0);
+
+    while (true) {
+
+        ssize_t sent = ::send(conn.socket.fd(), start, size, MSG_NOSIGNAL);
+        assert(sent); // No idea what to do with a return value of 0.
+
+        if (sent > 0) conn.bytesSent += sent;
+
+        if (sent == size) return true;
+        if (sent >= 0 && sent < size) {
+            start += sent;
+            size -= sent;
+            assert(size > 0);
+            continue;
+        }
+
+        // sent < 0
+
+        if (errno == EINTR) continue;
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            conn.writable = false;
+
+            size_t pos = data.packetSize() - size;
+            pushToSendQueue(conn, std::forward<Payload>(data), pos);
+
+            if (ring) armWrite(conn);
+            return true;
+        }
+
+        else if (errno == ECONNRESET || errno == EPIPE) return false;
+        SLICK_CHECK_ERRNO(sent >= 0, "Endpoint.sendTo.send");
+    }
+}
+
+
+void
+Endpoint::
+send(int fd, Payload&& data)
+{
+    if (!isPollThread()) {
+        if (!sends.tryDefer(fd, std::move(data)))
+            dropPayload(fd, std::move(data));
+        return;
+    }
+
+    auto conn = connection(fd);
+
+    if (!conn) {
+        dropPayload(fd, std::move(data));
+        return;
+    }
+
+    if (!sendTo(*conn, std::move(data))) {
+        dropPayload(fd, std::move(data));
+        disconnect(fd);
+    }
+}
+
+void
+Endpoint::
+multicast(const SortedVector<int>& fds, Payload&& data)
+{
+    if (fds.size() == 1) {
+        send(fds.front(), std::move(data));
+        return;
+    }
+
+    if (!isPollThread()) {
+        if (!multicasts.tryDefer(fds, std::move(data))) {
+            for (int fd : fds)
+                dropPayload(fd, data);
+        }
+        return;
+    }
+
+    for (int fd : fds) {
+        auto conn = connection(fd);
+
+        if (!conn) {
+            dropPayload(fd, data);
+            continue;
+        }
+
+        if (!sendTo(*conn, data)) {
+            dropPayload(fd, data);
+            disconnect(fd);
+        }
+    }
+}
+
+void
+Endpoint::
+broadcast(Payload&& data)
+{
+    if (!isPollThread()) {
+        if (!broadcasts.tryDefer(std::move(data)))
+            dropPayload(-1, std::move(data));
+        return;
+    }
+
+    // Indexing instead of iterating because a callback could grow the table.
+    for (size_t fd = 0; fd < connections.size(); ++fd) {
+        auto& conn = connections[fd];
+        if (!conn.socket) continue;
+
+        if (!sendTo(conn, data)) {
+            dropPayload(fd, data);
+            disconnect(fd);
+        }
+    }
+}
+
+
+void
+Endpoint::
+flushQueue(ConnectionState& conn)
+{
+    int fd = conn.socket.fd();
+
+    if (!conn.connected) {
+        if (onNewConnection) onNewConnection(conn.socket.fd());
+        conn.connected = true;
+    }
+    conn.writable = true;
+
+    if (flushSendQueue(conn)) {
+        checkWatermarks(conn);
+        return;
+    }
+
+    auto queue = std::move(conn.sendQueue);
+    for (auto& entry : queue)
+        dropPayload(fd, std::move(entry.first));
+
+    disconnect(fd);
+}
+
+
+/** Gathers as much of the queue as we can into a single sendmsg call. Partial
+    writes can end anywhere in the batch so we have to walk the queue to figure
+    out which payloads were fully sent and where to resume the rest.
+
+    Returns false if the connection was lost in which case the queue is left
+    as-is so that the caller can drop its payloads.
+ */
+bool
+Endpoint::
+flushSendQueue(ConnectionState& conn)
+{
+    enum { MaxIov = IOV_MAX };
+    struct iovec iov[MaxIov];
+
+    auto& queue = conn.sendQueue;
+
+    while (!queue.empty()) {
+
+        size_t n = 0;
+        for (auto it = queue.begin(); it != queue.end() && n < MaxIov; ++it, ++n) {
+            iov[n].iov_base = const_cast<uint8_t*>(it->first.packet() + it->second);
+            iov[n].iov_len = it->first.packetSize() - it->second;
+        }
+
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof msg);
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+
+        ssize_t sent = sendmsg(conn.socket.fd(), &msg, MSG_NOSIGNAL);
+
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn.writable = false;
+                if (ring) armWrite(conn);
+                return true;
+            }
+
+            if (errno == ECONNRESET || errno == EPIPE) return false;
+            SLICK_CHECK_ERRNO(sent >= 0, "Endpoint.flushSendQueue.sendmsg");
+        }
+
+        assert(sent); // No idea what to do with a return value of 0.
+        consumeSendQueue(conn, sent);
+    }
+
+    return true;
+}
+
+void
+Endpoint::
+consumeSendQueue(ConnectionState& conn, size_t sent)
+{
+    auto& queue = conn.sendQueue;
+
+    conn.bytesSent += sent;
+    conn.queuedBytes -= sent;
+    queuedBytes_ -= sent;
+
+    size_t left = sent;
+    while (left) {
+        auto& entry = queue.front();
+        size_t remaining = entry.first.packetSize() - entry.second;
+
+        if (left < remaining) {
+            entry.second += left;
+            break;
+        }
+
+        left -= remaining;
+        queue.pop_front();
+    }
+}
+
+
+/******************************************************************************/
+/* URING                                                                      */
+/******************************************************************************/
+
+/** Submissions queued while reaping a batch of completions are held back and
+    handed to the kernel in a single io_uring_enter once the batch is done.
+ */
+void
+Endpoint::
+submit()
+{
+    if (!reaping) ring->submit();
+}
+
+void
+Endpoint::
+reap()
+{
+    {
+        FlagGuard guard(reaping);
+        while (ring->poll()) dispatch(ring->next());
+    }
+
+    ring->submit();
+}
+
+void
+Endpoint::
+dispatch(const struct io_uring_cqe& cqe)
+{
+    // Recycled buffers only complete if they couldn't be handed back.
+    if (tagOp(cqe.user_data) == OpBuffers) {
+        auto errStr = checkErrnoString(-cqe.res, "Endpoint.recycle");
+        throw std::logic_error(errStr);
+    }
+
+    // Multishot operations stay armed for as long as the kernel says so.
+    if (!(cqe.flags & IORING_CQE_F_MORE)) ringOps--;
+
+    switch (tagOp(cqe.user_data)) {
+    case OpAccept:   onAccept(cqe); break;
+    case OpRecv:     onRecv(cqe); break;
+    case OpWritable: onWritable(cqe); break;
+    case OpSend:     onSent(cqe); break;
+    case OpCancel:   break;
+    default: assert(false);
+    }
+}
+
+void
+Endpoint::
+armAccept(int fd)
+{
+    struct io_uring_sqe* sqe = ring->sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = opTag(OpAccept, fd);
+
+    ringOps++;
+    acceptOps++;
+    submit();
+}
+
+void
+Endpoint::
+armRecv(ConnectionState& conn)
+{
+    int fd = conn.socket.fd();
+
+    struct io_uring_sqe* sqe = ring->sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = ringBuffers->group();
+    sqe->user_data = opTag(OpRecv, fd, conn.gen);
+
+    conn.recvArmed = true;
+    ringOps++;
+    submit();
+}
+
+/** Waits for the socket to become writable if there's nothing queued which is
+    also how we find out that a connection was established. Otherwise hands as
+    much of the queue as we can to the kernel in a single sendmsg.
+ */
+void
+Endpoint::
+armWrite(ConnectionState& conn)
+{
+    auto& op = *conn.uringWrite;
+    assert(!op.inFlight);
+
+    struct io_uring_sqe* sqe = ring->sqe();
+    sqe->fd = conn.socket.fd();
+
+    if (conn.sendQueue.empty()) {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = POLLOUT;
+        sqe->user_data = opTag(OpWritable, &op);
+    }
+
+    else {
+        size_t n = 0;
+        auto& queue = conn.sendQueue;
+
+        op.pinned.clear();
+        for (auto it = queue.begin();
+             it != queue.end() && n < UringWrite::MaxIov; ++it, ++n)
+        {
+            op.iov[n].iov_base = const_cast<uint8_t*>(it->first.packet() + it->second);
+            op.iov[n].iov_len = it->first.packetSize() - it->second;
+            op.pinned.push_back(it->first);
+        }
+
+        std::memset(&op.msg, 0, sizeof op.msg);
+        op.msg.msg_iov = op.iov;
+        op.msg.msg_iovlen = n;
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->addr = uint64_t(&op.msg);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = opTag(OpSend, &op);
+    }
+
+    op.inFlight = true;
+    ringOps++;
+    submit();
+}
+
+/** Cancels every operation on the given fd or everything if the fd is -1. */
+void
+Endpoint::
+cancel(int fd)
+{
+    struct io_uring_sqe* sqe = ring->sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL |
+        (fd < 0 ? IORING_ASYNC_CANCEL_ANY : IORING_ASYNC_CANCEL_FD);
+    sqe->user_data = opTag(OpCancel, fd);
+
+    ringOps++;
+    submit();
+}
+
+void
+Endpoint::
+retire(UringWrite* op)
+{
+    auto it = std::find_if(retiredWrites.begin(), retiredWrites.end(),
+            [=] (const std::unique_ptr<UringWrite>& other) {
+                return other.get() == op;
+            });
+    assert(it != retiredWrites.end());
+
+    std::swap(*it, retiredWrites.back());
+    retiredWrites.pop_back();
+}
+
+void
+Endpoint::
+onAccept(const struct io_uring_cqe& cqe)
+{
+    int fd = tagOpFd(cqe.user_data);
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+    if (!more) acceptOps--;
+
+    if (!listenSockets.test(fd)) {
+        if (cqe.res >= 0) close(cqe.res);
+        return;
+    }
+
+    if (cqe.res >= 0) connect(Socket::adopt(cqe.res));
+
+    else if (cqe.res == -ECANCELED) return;
+
+    else if (cqe.res != -EAGAIN && cqe.res != -EINTR) {
+        auto errStr = checkErrnoString(-cqe.res, "Endpoint.accept");
+        throw std::logic_error(errStr);
+    }
+
+    if (!more) armAccept(fd);
+}
+
+void
+Endpoint::
+onRecv(const struct io_uring_cqe& cqe)
+{
+    int fd = tagOpFd(cqe.user_data);
+    uint32_t gen = tagOpGen(cqe.user_data);
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+
+    const uint8_t* it = nullptr;
+    uint16_t id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+    if (cqe.flags & IORING_CQE_F_BUFFER) it = ringBuffers->get(id);
+
+    auto conn = connection(fd);
+    if (!conn || conn->gen != gen) {
+        if (it) ringBuffers->recycle(id);
+        return;
+    }
+
+    if (cqe.res > 0) {
+        assert(it);
+        conn->bytesRecv += cqe.res;
+
+        // Completions that were already on their way when the connection got
+        // paused are held on to until it's resumed.
+        bool valid = true;
+        if (conn->readsOff) conn->stash.insert(conn->stash.end(), it, it + cqe.res);
+        else valid = recvBytes(*conn, it, cqe.res);
+
+        ringBuffers->recycle(id);
+
+        if (!valid) {
+            if (connection(fd)) disconnect(fd);
+            return;
+        }
+    }
+
+    else {
+        if (it) ringBuffers->recycle(id);
+
+        // Indicates that shutdown was called on the client side.
+        if (!cqe.res) {
+            disconnect(fd);
+            return;
+        }
+
+        // Ran out of provided buffers which we've since recycled.
+        if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+            if (!onError || onError(fd, -cqe.res)) {
+                disconnect(fd);
+                return;
+            }
+        }
+    }
+
+    if (more) return;
+
+    conn = connection(fd);
+    if (!conn || conn->gen != gen) return;
+
+    conn->recvArmed = false;
+    if (!conn->disconnected && !conn->readsOff) armRecv(*conn);
+}
+
+/** The provided buffers are shared by every connection so whatever is in them
+    has to be moved into the connection's buffer to be framed.
+
+    Returns false if a frame is larger then we're willing to buffer.
+ */
+bool
+Endpoint::
+recvBytes(ConnectionState& conn, const uint8_t* it, size_t size)
+{
+    int fd = conn.socket.fd();
+    auto& buffer = conn.recvBuffer;
+
+    std::vector<Payload> queue = std::move(recvQueue);
+    bool valid = true;
+
+    while (size) {
+        uint8_t* dest = buffer.prepare();
+        size_t n = std::min(size, buffer.available());
+
+        std::memcpy(dest, it, n);
+        buffer.commit(n);
+        it += n;
+        size -= n;
+
+        if (!readFrames(conn, queue)) {
+            valid = false;
+            break;
+        }
+    }
+
+    deliver(fd, queue);
+    recvQueue = std::move(queue);
+
+    return valid;
+}
+
+/** Frames whatever io_uring handed us while the connection was paused. */
+void
+Endpoint::
+recvStash(ConnectionState& conn)
+{
+    if (conn.readsOff || conn.stash.empty()) return;
+
+    int fd = conn.socket.fd();
+    std::vector<uint8_t> stash = std::move(conn.stash);
+
+    if (!recvBytes(conn, stash.data(), stash.size()) && connection(fd))
+        disconnect(fd);
+}
+
+void
+Endpoint::
+onWritable(const struct io_uring_cqe& cqe)
+{
+    auto op = tagOpPtr<UringWrite>(cqe.user_data);
+    op->inFlight = false;
+
+    if (!op->conn) {
+        retire(op);
+        return;
+    }
+
+    auto& conn = *op->conn;
+    int fd = conn.socket.fd();
+
+    if (cqe.res < 0) {
+        if (cqe.res == -ECANCELED) return;
+        if (!onError || onError(fd, -cqe.res)) disconnect(fd);
+        return;
+    }
+
+    if (cqe.res & POLLERR) {
+        int err = conn.socket.error();
+        if (err && (!onError || onError(fd, err))) disconnect(fd);
+    }
+
+    flushQueue(conn);
+}
+
+void
+Endpoint::
+onSent(const struct io_uring_cqe& cqe)
+{
+    auto op = tagOpPtr<UringWrite>(cqe.user_data);
+    op->inFlight = false;
+    op->pinned.clear();
+
+    if (!op->conn) {
+        retire(op);
+        return;
+    }
+
+    auto& conn = *op->conn;
+    int fd = conn.socket.fd();
+
+    if (cqe.res < 0) {
+        int err = -cqe.res;
+
+        if (err == EINTR || err == EAGAIN) {
+            armWrite(conn);
+            return;
+        }
+
+        // Released like consumeSendQueue would so that the accounting holds
+        // up if the connection is kept around.
+        auto queue = std::move(conn.sendQueue);
+        for (auto& entry : queue) {
+            size_t bytes = entry.first.packetSize() - entry.second;
+            conn.queuedBytes -= bytes;
+            queuedBytes_ -= bytes;
+            dropPayload(fd, std::move(entry.first));
+        }
+
+        if (err == ECONNRESET || err == EPIPE) disconnect(fd);
+        else if (!onError || onError(fd, err)) disconnect(fd);
+        else {
+            conn.writable = true;
+            checkWatermarks(conn);
+        }
+        return;
+    }
+
+    consumeSendQueue(conn, cqe.res);
+
+    if (conn.sendQueue.empty()) conn.writable = true;
+    else armWrite(conn);
+
+    checkWatermarks(conn);
 }
 
 } // slick
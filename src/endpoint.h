@@ -12,13 +12,22 @@
 #include "notify.h"
 #include "poll.h"
 #include "payload.h"
+#include "recv_buffer.h"
 #include "defer.h"
 #include "sorted_vector.h"
+#include "uring.h"
+#include "timer.h"
 
+#include <deque>
 #include <vector>
+#include <memory>
 #include <functional>
 #include <unordered_map>
+#include <cassert>
 #include <cstdint>
+#include <cstring>
+#include <sys/uio.h>
+#include <sys/socket.h>
 
 namespace slick {
 
@@ -28,8 +37,21 @@ namespace slick {
 
 struct Endpoint : public ThreadAwarePollable
 {
-    Endpoint();
-    Endpoint(Port listenPort);
+    /** The epoll backend is readiness based and reads and writes each socket
+        until it returns EAGAIN. The io_uring backend is completion based: it
+        accepts and receives through multishot operations which read into a
+        group of buffers provided to the kernel (IORING_OP_PROVIDE_BUFFERS) and
+        sends are only handed off to the ring once a socket's buffer is full. Operations queued while
+        handling a batch of completions are submitted together.
+
+        Either way the endpoint is polled through fd() and the callbacks are
+        invoked the same way.
+     */
+    enum class Backend { Epoll, Uring };
+
+    explicit Endpoint(Backend backend = Backend::Epoll);
+    Endpoint(Port listenPort, bool reusePort = false,
+            Backend backend = Backend::Epoll);
     virtual ~Endpoint();
 
     Endpoint(const Endpoint&) = delete;
@@ -43,15 +65,204 @@ struct Endpoint : public ThreadAwarePollable
     PayloadFn onPayload;
     PayloadFn onDroppedPayload;
 
+    /** If set, replaces onPayload and is handed every payload read from a
+        connection in a single readable event at once. The connection can be
+        closed by the callback itself, say on a bad payload, in which case the
+        rest of the batch should be dropped: check that the connection is
+        still around before handling each payload.
+     */
+    typedef std::function<void(int fd, PayloadSpan batch)> PayloadBatchFn;
+    PayloadBatchFn onPayloadBatch;
+
+    /** If set, payloads larger than the chunk threshold are handed out in
+        chunks as they arrive instead of being buffered and handed whole to
+        onPayload. Chunks of a payload are always delivered in order and
+        without any other payload of the connection in between.
+     */
+    typedef std::function<void(int fd, const PayloadChunk& chunk)> PayloadChunkFn;
+    PayloadChunkFn onPayloadChunk;
+
     typedef std::function<bool(int fd, int errnum)> ErrorFn;
     ErrorFn onError;
 
+    // Called with an fd of -1 when the watermarks of the endpoint are crossed.
+    ConnectionFn onHighWatermark;
+    ConnectionFn onLowWatermark;
+
+
+    /** Send queue limits in bytes. Going over the high watermark will trigger
+        onHighWatermark and draining back down to the low watermark will then
+        trigger onLowWatermark. Payloads which would push a queue past its max
+        are dropped.
+     */
+    struct QueueLimits
+    {
+        enum {
+            DefaultLow  = 1U << 18,
+            DefaultHigh = 1U << 20,
+            DefaultMax  = 1U << 24,
+        };
+
+        size_t lowWatermark;
+        size_t highWatermark;
+        size_t maxBytes;
+
+        QueueLimits(
+                size_t low = DefaultLow,
+                size_t high = DefaultHigh,
+                size_t max = DefaultMax) :
+            lowWatermark(low), highWatermark(high), maxBytes(max)
+        {
+            assert(low <= high && high <= max);
+        }
+
+        static QueueLimits unlimited()
+        {
+            size_t max = -1;
+            return QueueLimits(max, max, max);
+        }
+    };
+
+    // Limits applied to newly created connections.
+    void queueLimits(const QueueLimits& limits);
+
+    // Must be called from the poll thread.
+    void queueLimits(int fd, const QueueLimits& limits);
+
+    // Limits applied to the sum of all the send queues. Unlimited by default.
+    void endpointQueueLimits(const QueueLimits& limits);
+
+    size_t queuedBytes() const { return queuedBytes_; }
+    size_t queuedBytes(int fd) const;
+
+
+    enum {
+        DefaultChunkThreshold = 1U << 20,
+        DefaultMaxPayloadSize = 1U << 26,
+        DefaultReadBudget     = 1U << 18,
+    };
+
+    void chunkThreshold(size_t bytes);
+
+    // Connections announcing a larger payload that won't be streamed are
+    // dropped before anything gets allocated for it.
+    void maxPayloadSize(size_t bytes);
+
+    /** Bytes read from a connection in one go before it has to yield to the
+        other connections. A connection that is over budget with data left to
+        read goes to the back of a ready list which is worked through in
+        round-robin alongside the next batch of events. 0 disables the budget.
+
+        Only applies to the epoll backend as io_uring already hands out reads
+        one buffer at a time.
+     */
+    void readBudget(size_t bytes);
+
+
+    /** Liveness checks in seconds where 0 disables the check.
+
+        - idle: connection is dropped if no payload went either way.
+        - read: connection is dropped if nothing at all was received.
+        - heartbeat: an empty frame is sent if nothing else was.
+
+        A read timeout only makes sense if the other side sends heartbeats
+        more often than that. Heartbeats are swallowed by the receiving
+        endpoint which means that empty payloads are never delivered.
+
+        Checks are done by a periodic sweep over every connection which runs
+        at a quarter of the smallest timeout and that's also their accuracy.
+     */
+    struct Timeouts
+    {
+        double idle;
+        double read;
+        double heartbeat;
+
+        Timeouts(double idle = 0, double read = 0, double heartbeat = 0) :
+            idle(idle), read(read), heartbeat(heartbeat)
+        {}
+    };
+
+    void timeouts(const Timeouts& timeouts);
+
+
+    /** Reading from a paused connection stops altogether which leaves it to
+        TCP flow control to push back on the sender once the socket buffers
+        fill up. Can be called from any thread.
+     */
+    void pauseReads(int fd);
+    void resumeReads(int fd);
+
+    /** Automatic read pausing for consumers that hold on to payloads past
+        their callback. Bytes handed out through onPayload or onPayloadBatch
+        count as pending until they're handed back through consumed(). Reads
+        on a connection are paused once it has more than high bytes pending
+        and resumed once it's back down to low. A high of 0 disables it which
+        is the default.
+
+        consumed() can be called from any thread and is ignored if the
+        connection has since gone away.
+     */
+    void pendingLimits(size_t low, size_t high);
+    void consumed(int fd, size_t bytes);
+
+    // Must be called from the poll thread.
+    size_t pendingBytes(int fd) const;
+
+
+    /** End-to-end flow control where the receiving side of a connection
+        grants the sending side credits in bytes of payload. A connection
+        starts out with a window's worth of credits and the bytes are granted
+        back once they've been delivered or, if pending limits are set, once
+        they've been consumed.
+
+        Payloads sent without enough credits are held by the sender until the
+        credits come in. They count towards the queue watermarks but are never
+        dropped for lack of credits so producers should back off on
+        onHighWatermark. A single payload can overdraw the credits which keeps
+        payloads larger than the window from stalling forever.
+
+        Credits are exchanged through control frames so both ends of a
+        connection must enable it. A window of 0 disables it which is the
+        default.
+     */
+    void creditWindow(size_t bytes);
+
+    struct CreditStats
+    {
+        int64_t credits;      // Left to spend; negative when overdrawn.
+        size_t heldPayloads;  // Waiting on credits.
+        size_t heldBytes;
+        size_t stalls;        // Payloads that had to wait on credits.
+        size_t granted;       // Bytes granted to the other side.
+        size_t received;      // Bytes granted by the other side.
+    };
+
+    // Must be called from the poll thread.
+    CreditStats creditStats(int fd) const;
+
+
+    /** Low latency mode where poll spins for up to the given budget before
+        blocking (see Epoll::spin) and the sockets of new connections are set
+        to busy poll the device queues for as long on reads. Spinning only
+        kicks in for polls with a timeout so the thread driving the endpoint
+        should be pinned to a dedicated cpu (see PollThread::pin). A budget of
+        0 disables it which is the default.
+     */
+    void spin(size_t budgetUs);
+
+    // Must be called from the poll thread.
+    const Epoll::SpinStats& spinStats() const { return poller.spinStats(); }
+
+    // Caps how many events are picked up by a single epoll_wait. See Epoll.
+    void maxEvents(size_t events);
+
 
     int fd() const { return poller.fd(); }
     void poll(int timeoutMs = 0);
     void stopPolling();
 
-    void listen(Port listenPort);
+    void listen(Port listenPort, bool reusePort = false);
 
     void send(int fd, Payload&& data);
     void send(int fd, const Payload& data)
@@ -83,38 +294,97 @@ private:
 
     struct Operation;
     struct ConnectionState;
+    struct UringWrite;
 
-    void init();
+    void init(Backend backend);
 
     void accept(int fd);
 
-    void recvPayload(int fd);
-    uint8_t* processRecvBuffer(uint8_t*, uint8_t*, std::vector<Payload>&);
+    ConnectionState* connection(int fd);
+    const ConnectionState* connection(int fd) const;
+
+    void recvPayload(ConnectionState& conn);
+    void pollReads();
+    void queueRead(ConnectionState& conn);
+    void updateReads(ConnectionState& conn);
+    void doPauseReads(int fd, bool pause);
+    void doConsumed(int fd, size_t bytes);
+    void onControl(ConnectionState& conn, const Payload& data);
+    void grantCredits(ConnectionState& conn, size_t bytes);
+    void releaseCredits(ConnectionState& conn);
+    bool readFrames(ConnectionState& conn, std::vector<Payload>& queue);
+    void deliver(int fd, std::vector<Payload>& queue);
 
     template<typename Payload>
     void pushToSendQueue(ConnectionState& conn, Payload&& data, size_t offset);
 
     template<typename Payload>
-    bool sendTo(ConnectionState& conn, Payload&& data, size_t offset = 0);
+    bool sendTo(ConnectionState& conn, Payload&& data);
 
     template<typename Payload>
     void dropPayload(int h, Payload&& payload) const;
 
-    void flushQueue(int fd);
+    void flushQueue(ConnectionState& conn);
+    bool flushSendQueue(ConnectionState& conn);
+    void consumeSendQueue(ConnectionState& conn, size_t sent);
+    void checkWatermarks(ConnectionState& conn);
     void onOperation(Operation&& op);
+    void sweep(uint64_t ticks);
 
     void doDisconnect(std::vector<int> fd);
     void doDisconnect(int fd);
 
+    void submit();
+    void reap();
+    void dispatch(const struct io_uring_cqe& cqe);
+    void armAccept(int fd);
+    void armRecv(ConnectionState& conn);
+    void armWrite(ConnectionState& conn);
+    void cancel(int fd);
+    void retire(UringWrite* op);
+    void onAccept(const struct io_uring_cqe& cqe);
+    void onRecv(const struct io_uring_cqe& cqe);
+    bool recvBytes(ConnectionState& conn, const uint8_t* it, size_t size);
+    void recvStash(ConnectionState& conn);
+    void onWritable(const struct io_uring_cqe& cqe);
+    void onSent(const struct io_uring_cqe& cqe);
+
 
     Epoll poller;
 
+    /** Write side of a connection when using the io_uring backend. Has to
+        outlive its connection if an operation is still in flight so it pins
+        the payloads being sent.
+     */
+    struct UringWrite
+    {
+        enum { MaxIov = 1 << 6 };
+
+        explicit UringWrite(ConnectionState* conn) :
+            conn(conn), inFlight(false)
+        {}
+
+        ConnectionState* conn; // null once the connection is gone.
+        bool inFlight;
+
+        struct msghdr msg;
+        struct iovec iov[MaxIov];
+        std::vector<Payload> pinned;
+    };
+
     struct ConnectionState
     {
         ConnectionState() :
-            bytesSent(0), bytesRecv(0),
-            connected(false), disconnected(false), writable(false)
-        {}
+            gen(0), bytesSent(0), bytesRecv(0), queuedBytes(0),
+            lastRecv(0), lastSent(0), lastActive(0),
+            connected(false), disconnected(false), writable(false),
+            throttled(false), readReady(false),
+            readPaused(false), readLimited(false), readsOff(false),
+            recvArmed(false), pendingBytes(0),
+            credits(0), creditsOwed(0), releasing(false)
+        {
+            std::memset(&creditStats, 0, sizeof creditStats);
+        }
 
         ConnectionState(ConnectionState&&) = default;
         ConnectionState& operator=(ConnectionState&&) = default;
@@ -124,23 +394,113 @@ private:
 
         Socket socket;
 
+        // Distinguishes io_uring completions for a previous user of the fd.
+        uint32_t gen;
+
         size_t bytesSent;
         size_t bytesRecv;
+        size_t queuedBytes;
+
+        // Sweep ticks of the last activity.
+        uint64_t lastRecv;
+        uint64_t lastSent;
+        uint64_t lastActive;
 
         bool connected;
         bool disconnected;
         bool writable;
-        std::vector<std::pair<Payload, size_t> > sendQueue;
+        bool throttled;
+        bool readReady; // Queued in the ready list.
+
+        bool readPaused;  // through pauseReads()
+        bool readLimited; // by the pending limits
+        bool readsOff;    // whether the poller is still reading.
+        bool recvArmed;   // io_uring only.
+        size_t pendingBytes;
+
+        QueueLimits queueLimits;
+
+        RecvBuffer recvBuffer;
+
+        // io_uring reads that completed after the connection was paused.
+        std::vector<uint8_t> stash;
+
+        // Payloads along with the offset of the first byte left to send.
+        std::deque<std::pair<Payload, size_t> > sendQueue;
+
+        int64_t credits;
+        size_t creditsOwed; // Delivered but not yet granted back.
+        bool releasing;
+        std::deque<Payload> creditQueue;
+        CreditStats creditStats;
+
+        std::unique_ptr<UringWrite> uringWrite;
     };
 
-    std::unordered_map<int, ConnectionState> connections;
+    // Indexed by fd. A connection is active if its socket is valid.
+    std::deque<ConnectionState> connections;
+
+    size_t chunkThreshold_;
+    size_t maxPayloadSize_;
+    size_t readBudget_;
+
+    // Connections that went over their read budget with data left to read.
+    std::deque<int> readyReads;
+
+    size_t pendingLow_;
+    size_t pendingHigh_;
+    size_t creditWindow_;
+    size_t spinBudget_;
+
+    // Kept around between reads so that its capacity is reused.
+    std::vector<Payload> recvQueue;
+
+    QueueLimits queueLimits_;
+    QueueLimits endpointQueueLimits_;
+    size_t queuedBytes_;
+    bool throttled;
+
+    Timer sweepTimer;
+    uint64_t sweepTick;
+    uint64_t idleTicks;
+    uint64_t readTicks;
+    uint64_t heartbeatTicks;
+    Payload heartbeat;
 
     PassiveSockets listenSockets;
+    std::vector<PollSource> listenSources;
+
+    PollSource wakeupSource;
+    PollSource sweepSource;
+    PollSource ringSource;
+
+    std::unique_ptr<IoUring> ring;
+    std::unique_ptr<UringBuffers> ringBuffers;
+    std::vector<std::unique_ptr<UringWrite> > retiredWrites;
+    size_t ringOps;
+    size_t acceptOps;
+    uint32_t nextGen;
+    bool reaping;
 
     // Need a seperate queue that can't block when defering from within the
     // polling thread.
     std::vector<int> disconnectQueue;
-    Notify disconnectQueueFd;
+
+    // Every deferred queue shares a single fd registered with the poller.
+    enum {
+        WakeDisconnectQueue = 1 << 0,
+        WakeSends           = 1 << 1,
+        WakeMulticasts      = 1 << 2,
+        WakeBroadcasts      = 1 << 3,
+        WakeConnects        = 1 << 4,
+        WakeDisconnects     = 1 << 5,
+        WakeReads           = 1 << 6,
+        WakeReadControls    = 1 << 7,
+        WakeConsumes        = 1 << 8,
+    };
+    Wakeup wakeup;
+
+    void pollDeferred(uint64_t ready, size_t cap);
 
     enum { SendSize = 1 << 6 };
     Defer<SendSize, int, Payload> sends;
@@ -150,6 +510,8 @@ private:
     enum { ConnectSize = 1 << 4 };
     Defer<ConnectSize, Socket> connects;
     Defer<ConnectSize, int> disconnects;
+    Defer<ConnectSize, int, bool> readControls;
+    Defer<SendSize, int, size_t> consumes;
 
     enum { DeferCap = 1 << 6 };
 };
@@ -19,7 +19,9 @@ namespace slick {
 
 NamedEndpoint::
 NamedEndpoint(Discovery& discovery) :
-    discovery(discovery)
+    discovery(discovery),
+    connects(wakeup, WakeConnects),
+    watches(wakeup, WakeWatches)
 {
     using namespace std::placeholders;
 
@@ -28,10 +30,8 @@ NamedEndpoint(Discovery& discovery) :
 
     typedef void (NamedEndpoint::*ConnectFn)(const std::string&, FilterFn&&);
     connects.onOperation = std::bind((ConnectFn)&NamedEndpoint::connect, this,  _1, _2);
-    poller.add(connects.fd());
-
     watches.onOperation = std::bind(&NamedEndpoint::onWatch, this, _1, _2, _3, _4);
-    poller.add(watches.fd());
+    poller.add(wakeup.fd());
 }
 
 NamedEndpoint::
@@ -49,8 +49,11 @@ poll(int timeoutMs)
 
         struct epoll_event ev = poller.next();
 
-        if      (ev.data.fd == connects.fd()) connects.poll();
-        else if (ev.data.fd == watches.fd()) watches.poll();
+        if (ev.data.fd == wakeup.fd()) {
+            uint64_t ready = wakeup.poll();
+            if (ready & WakeConnects) connects.poll();
+            if (ready & WakeWatches) watches.poll();
+        }
         else endpoint.poll();
     }
 }
@@ -87,6 +87,12 @@ private:
     };
     std::unordered_map<int, Connection> connections;
 
+    enum {
+        WakeConnects = 1 << 0,
+        WakeWatches  = 1 << 1,
+    };
+    Wakeup wakeup;
+
     enum { QueueSize = 1 << 4 };
     Defer<QueueSize, std::string, FilterFn> connects;
     Defer<QueueSize, std::string, Discovery::WatchHandle, UUID, Payload> watches;
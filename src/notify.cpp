@@ -60,4 +60,27 @@ signal()
     SLICK_CHECK_ERRNO(!ret, "Notify.write");
 }
 
+
+/******************************************************************************/
+/* WAKEUP                                                                     */
+/******************************************************************************/
+
+uint64_t
+Wakeup::
+poll()
+{
+    // An eventfd read resets its counter so a single read is enough. Any
+    // signal raised after this point either shows up in the mask below or
+    // writes the fd again.
+    notify.poll();
+    return ready.exchange(0);
+}
+
+void
+Wakeup::
+signal(uint64_t mask)
+{
+    if (!ready.fetch_or(mask)) notify.signal();
+}
+
 } // slick
@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+
 namespace slick {
 
 /******************************************************************************/
@@ -30,4 +33,32 @@ private:
     int fd_;
 };
 
+
+/******************************************************************************/
+/* WAKEUP                                                                     */
+/******************************************************************************/
+
+/** Single fd shared by a set of sources that each own a bit of a ready mask.
+
+    The fd is only written when the mask goes from empty to non-empty so any
+    number of signals raised between two polls costs a single syscall.
+    poll() hands back the sources that were signaled since the last call.
+ */
+struct Wakeup
+{
+    Wakeup() : ready(0) {}
+
+    Wakeup(const Wakeup&) = delete;
+    Wakeup& operator=(const Wakeup&) = delete;
+
+    int fd() const { return notify.fd(); }
+
+    uint64_t poll();
+    void signal(uint64_t mask);
+
+private:
+    Notify notify;
+    std::atomic<uint64_t> ready;
+};
+
 } // slick
@@ -7,11 +7,32 @@
 
 #include "payload.h"
 
+#include <new>
 #include <algorithm>
-#include <limits>
 
 namespace slick {
 
+/******************************************************************************/
+/* SLAB                                                                       */
+/******************************************************************************/
+
+Slab*
+Slab::
+alloc(size_t capacity)
+{
+    uint8_t* bytes = new uint8_t[sizeof(Slab) + capacity];
+    return new (bytes) Slab(capacity);
+}
+
+void
+Slab::
+free()
+{
+    this->~Slab();
+    delete[] reinterpret_cast<uint8_t*>(this);
+}
+
+
 /******************************************************************************/
 /* PAYLOAD                                                                    */
 /******************************************************************************/
@@ -19,14 +40,12 @@ namespace slick {
 Payload::
 Payload(size_t size)
 {
-    assert(size < std::numeric_limits<SizeT>::max());
+    assert(size < ControlBit);
 
-    size_t totalSize = size + sizeof(SizeT);
+    slab_ = Slab::alloc(size + sizeof(SizeT));
+    bytes_ = slab_->data() + sizeof(SizeT);
 
-    uint8_t* bytes = new uint8_t[totalSize];
-    bytes_ = bytes + sizeof(SizeT);
-
-    *reinterpret_cast<SizeT*>(bytes) = size;
+    *reinterpret_cast<SizeT*>(slab_->data()) = size;
 }
 
 
@@ -34,7 +53,7 @@ Payload
 Payload::
 read(const uint8_t* buffer, size_t bufferSize)
 {
-    auto size = *reinterpret_cast<const SizeT*>(buffer);
+    auto size = *reinterpret_cast<const SizeT*>(buffer) & ~ControlBit;
     if (size + sizeof(SizeT) > bufferSize) return Payload();
 
     Payload data(size);
@@ -44,18 +63,29 @@ read(const uint8_t* buffer, size_t bufferSize)
     return std::move(data);
 }
 
-void
+Payload
 Payload::
-copy(const Payload& other)
+view(Slab* slab, const uint8_t* packet)
 {
-    SizeT size = other.packetSize();
-    const uint8_t* start = other.packet();
+    assert(packet >= slab->data());
+    assert(packet + sizeof(SizeT) <= slab->data() + slab->capacity());
+
+    Payload data;
+
+    slab->acquire();
+    data.slab_ = slab;
+    data.bytes_ = const_cast<uint8_t*>(packet) + sizeof(SizeT);
 
-    std::unique_ptr<uint8_t[]> bytes(new uint8_t[size]);
-    std::copy(start, start + size, bytes.get());
+    return data;
+}
 
-    bytes_ = bytes.release() + 2;
-    assert(this->size() == other.size());
+Payload
+Payload::
+control(size_t size)
+{
+    Payload data(size);
+    *reinterpret_cast<SizeT*>(data.start()) |= ControlBit;
+    return data;
 }
 
 } // slick
@@ -3,19 +3,54 @@
    FreeBSD-style copyright and disclaimer apply
 
    Payload seraizlization utilities.
-
-   Might want to consider just using shared_ptr to make everything much simpler.
 */
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 
 
 namespace slick {
 
+/******************************************************************************/
+/* SLAB                                                                       */
+/******************************************************************************/
+
+/** Reference counted block of memory that can be shared by multiple payloads.
+    Used to hand out payloads that point directly into a receive buffer instead
+    of copying each frame into its own allocation.
+
+    The counter is atomic because payloads are routinely moved across threads.
+ */
+struct Slab
+{
+    static Slab* alloc(size_t capacity);
+
+    void acquire() { refs.fetch_add(1, std::memory_order_relaxed); }
+    void release()
+    {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) free();
+    }
+
+    bool unique() const { return refs.load(std::memory_order_acquire) == 1; }
+
+    size_t capacity() const { return capacity_; }
+    uint8_t* data() { return reinterpret_cast<uint8_t*>(this + 1); }
+
+private:
+
+    Slab(size_t capacity) : capacity_(capacity), refs(1) {}
+    void free();
+
+    size_t capacity_;
+    std::atomic<size_t> refs;
+};
+
+
 /******************************************************************************/
 /* PAYLOAD                                                                    */
 /******************************************************************************/
@@ -34,36 +69,62 @@ namespace slick {
     sending over the wire which means that we avoid a copy.
 
     This also explains the distinction between the packet() and bytes()
-    functions.
+    functions. The size is 32 bits wide but its top bit flags control frames
+    which are exchanged between endpoints and never handed out which bounds a
+    payload to 2GB.
+
+    The bytes always live in a reference counted slab which is either owned
+    by the payload or shared with a receive buffer (see view()). Copying a
+    payload only bumps the reference count of the slab so the same message
+    can be queued on any number of connections without duplicating it.
+
+    This means that a payload should be considered immutable once it has been
+    copied. The non-const iterators are only meant to fill in a freshly
+    constructed payload.
  */
 struct Payload
 {
-    typedef uint16_t SizeT;
+    typedef uint32_t SizeT;
     typedef uint8_t* iterator;
     typedef const uint8_t* const_iterator;
 
 
-    Payload() : bytes_(nullptr) {}
+    enum : SizeT { ControlBit = SizeT(1) << 31 };
+
+    Payload() : bytes_(nullptr), slab_(nullptr) {}
     explicit Payload(size_t size);
     static Payload read(const uint8_t* buffer, size_t bufferSize);
+    static Payload view(Slab* slab, const uint8_t* packet);
+    static Payload control(size_t size);
 
 
-    Payload(const Payload& other) { copy(other); }
+    Payload(const Payload& other) : bytes_(other.bytes_), slab_(other.slab_)
+    {
+        if (slab_) slab_->acquire();
+    }
     Payload& operator= (const Payload& other)
     {
+        if (this == &other) return *this;
+
         clear();
-        copy(other);
+        bytes_ = other.bytes_;
+        slab_ = other.slab_;
+        if (slab_) slab_->acquire();
+
         return *this;
     }
 
-    Payload(Payload&& other) noexcept : bytes_(other.bytes_)
+    Payload(Payload&& other) noexcept :
+        bytes_(other.bytes_), slab_(other.slab_)
     {
         other.bytes_ = nullptr;
+        other.slab_ = nullptr;
     }
     Payload& operator= (Payload&& other) noexcept
     {
         clear();
         std::swap(bytes_, other.bytes_);
+        std::swap(slab_, other.slab_);
         return *this;
     }
 
@@ -71,8 +132,10 @@ struct Payload
     void clear()
     {
         if (!bytes_) return;
-        delete[] start();
+
+        slab_->release();
         bytes_ = nullptr;
+        slab_ = nullptr;
     }
 
     operator bool() const { return bytes_; }
@@ -85,27 +148,56 @@ struct Payload
 
 
     const uint8_t* bytes() const { return bytes_; }
-    size_t size() const { return *reinterpret_cast<const SizeT*>(start()); }
+    size_t size() const { return header() & ~ControlBit; }
+
+    bool isControl() const { return bytes_ && (header() & ControlBit); }
 
     const uint8_t* packet() const { return bytes_ ? start() : nullptr; }
     size_t packetSize() const
     {
-        return bytes_ ? pSize(start()) + sizeof(SizeT) : 0ULL;
+        return bytes_ ? size() + sizeof(SizeT) : 0ULL;
     }
 
 private:
 
-    void copy(const Payload& other);
+    SizeT header() const { return *reinterpret_cast<const SizeT*>(start()); }
 
     uint8_t* start() { return bytes_ - sizeof(SizeT); }
     uint8_t* start() const { return bytes_ - sizeof(SizeT); }
 
-    SizeT& pSize(uint8_t* start) const
+    uint8_t* bytes_;
+    Slab* slab_;
+};
+
+
+/******************************************************************************/
+/* PAYLOAD SPAN                                                               */
+/******************************************************************************/
+
+/** Non-owning view over a contiguous batch of payloads. The payloads can be
+    moved out of the span but the span itself is only valid for the duration
+    of the call it was handed to.
+ */
+struct PayloadSpan
+{
+    PayloadSpan() : first(nullptr), last(nullptr) {}
+    PayloadSpan(Payload* first, size_t n) : first(first), last(first + n) {}
+
+    Payload* begin() const { return first; }
+    Payload* end() const { return last; }
+
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+
+    Payload& operator[] (size_t i) const
     {
-        return *reinterpret_cast<SizeT*>(start);
+        assert(i < size());
+        return first[i];
     }
 
-    uint8_t* bytes_;
+private:
+    Payload* first;
+    Payload* last;
 };
 
 } // slick
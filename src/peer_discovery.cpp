@@ -75,6 +75,7 @@ PeerDiscovery(const std::vector<Address>& seeds, Port port) :
     connExpThresh_(DefaultExpThresh),
     myId(UUID::random()),
     seeds(seeds),
+    resolvingSeeds(0),
     rng(lockless::wall()),
     endpoint(port),
     timer(period_)
@@ -86,10 +87,11 @@ PeerDiscovery(const std::vector<Address>& seeds, Port port) :
 
     using namespace std::placeholders;
 
-    endpoint.onPayload = bind(&PeerDiscovery::onPayload, this, _1, _2);
+    endpoint.onPayloadBatch = bind(&PeerDiscovery::onPayload, this, _1, _2);
     endpoint.onNewConnection = bind(&PeerDiscovery::onConnect, this, _1);
     endpoint.onLostConnection = bind(&PeerDiscovery::onDisconnect, this, _1);
     poller.add(endpoint);
+    poller.add(resolver);
 
     timer.onTimer = bind(&PeerDiscovery::onTimer, this, _1);
     poller.add(timer);
@@ -121,28 +123,29 @@ poll(size_t timeoutMs)
 
 void
 PeerDiscovery::
-onPayload(int fd, const Payload& data)
+onPayload(int fd, PayloadSpan batch)
 {
-    auto connIt = connections.find(fd);
-    assert(connIt != connections.end());
-    auto& conn = connIt->second;
-
-
-    auto it = data.cbegin(), last = data.cend();
-
-    if (!conn.initialized()) it = onInit(conn, it, last);
-
-    while (it != last) {
-        Msg::Type type;
-        it = unpack(type, it, last);
-
-        switch(type) {
-        case Msg::Keys:  it = onKeys(conn, it, last); break;
-        case Msg::Query: it = onQuery(conn, it, last); break;
-        case Msg::Nodes: it = onNodes(conn, it, last); break;
-        case Msg::Fetch: it = onFetch(conn, it, last); break;
-        case Msg::Data:  it = onData(conn, it, last); break;
-        default: assert(false);
+    for (const auto& data : batch) {
+        auto connIt = connections.find(fd);
+        if (connIt == connections.end()) return;
+        auto& conn = connIt->second;
+
+        auto it = data.cbegin(), last = data.cend();
+
+        if (!conn.initialized()) it = onInit(conn, it, last);
+
+        while (it != last) {
+            Msg::Type type;
+            it = unpack(type, it, last);
+
+            switch(type) {
+            case Msg::Keys:  it = onKeys(conn, it, last); break;
+            case Msg::Query: it = onQuery(conn, it, last); break;
+            case Msg::Nodes: it = onNodes(conn, it, last); break;
+            case Msg::Fetch: it = onFetch(conn, it, last); break;
+            case Msg::Data:  it = onData(conn, it, last); break;
+            default: assert(false);
+            }
         }
     }
 }
@@ -506,15 +509,20 @@ sendFetch(const std::string& key, const UUID& keyId, const NodeAddress& node)
     auto it = list.insert(std::make_pair(keyId, Fetch(node))).first;
     fetchExpiration.emplace_back(key, keyId, it->second.delay);
 
-    auto socket = Socket::connect(node);
-    if (!socket) return;
+    resolver.connect(node, [=] (Socket&& socket) {
+        if (!socket) return;
+
+        // The data could have shown up while we were resolving.
+        auto keyIt = fetches.find(key);
+        if (keyIt == fetches.end() || !keyIt->second.count(keyId)) return;
 
-    int fd = socket.fd();
-    print(myId, "conn", fd, node);
+        int fd = socket.fd();
+        print(myId, "conn", fd, node);
 
-    assert(!connections.count(fd));
-    connections[fd].fetch(key, keyId);
-    endpoint.connect(std::move(socket));
+        assert(!connections.count(fd));
+        connections[fd].fetch(key, keyId);
+        endpoint.connect(std::move(socket));
+    });
 }
 
 ConstPackIt
@@ -716,16 +724,24 @@ randomConnect(double now)
 
         auto connIt = connectedNodes.find(nodeIt->id);;
         if (connIt != connectedNodes.end()) continue;
+        if (!resolvingNodes.insert(nodeIt->id).second) continue;
 
-        auto socket = Socket::connect(nodeIt->addrs);
-        int fd = socket.fd();
-        if (!fd) continue;
+        Item node = *nodeIt;
+        resolver.connect(node.addrs, [=] (Socket&& socket) {
+            resolvingNodes.erase(node.id);
+            if (!socket) return;
 
-        connectedNodes.emplace(nodeIt->id, fd);
-        connections[fd].nodeId = nodeIt->id;
+            // Might have been connected to from the other side in the
+            // meantime.
+            if (connectedNodes.count(node.id)) return;
 
-        print(myId, "rcon", fd, *nodeIt, connects);
-        endpoint.connect(std::move(socket));
+            int fd = socket.fd();
+            connectedNodes.emplace(node.id, fd);
+            connections[fd].nodeId = node.id;
+
+            print(myId, "rcon", fd, node);
+            endpoint.connect(std::move(socket));
+        });
     }
 }
 
@@ -734,16 +750,19 @@ PeerDiscovery::
 seedConnect(double)
 {
     // \todo Should periodicatlly try to reconnect to this to heal partitions.
-    if (!connections.empty()) return;
+    if (!connections.empty() || resolvingSeeds) return;
 
-    for (size_t i = 0; i < seeds.size(); ++i) {
-        auto socket = Socket::connect(seeds[i]);
-        if (!socket.fd()) continue;
+    for (const auto& seed : seeds) {
+        resolvingSeeds++;
 
-        print(myId, "seed", socket.fd(), seeds[i]);
-        endpoint.connect(std::move(socket));
-    }
+        resolver.connect(seed, [=] (Socket&& socket) {
+            resolvingSeeds--;
+            if (!socket) return;
 
+            print(myId, "seed", socket.fd(), seed);
+            endpoint.connect(std::move(socket));
+        });
+    }
 }
 
 } // slick
@@ -9,6 +9,7 @@
 
 #include "discovery.h"
 #include "endpoint.h"
+#include "resolver.h"
 #include "pack.h"
 #include "poll.h"
 #include "defer.h"
@@ -20,6 +21,7 @@
 #include <map>
 #include <deque>
 #include <string>
+#include <unordered_set>
 
 
 namespace slick {
@@ -209,6 +211,10 @@ private:
 
     std::unordered_map<int, ConnState> connections;
     std::unordered_map<UUID, int> connectedNodes;
+
+    // Connects waiting on name resolution.
+    std::unordered_set<UUID> resolvingNodes;
+    size_t resolvingSeeds;
     std::deque<ConnExpItem> connExpiration;
     SortedVector<int> edges;
 
@@ -222,13 +228,14 @@ private:
     std::mt19937 rng;
 
     SourcePoller poller;
+    Resolver resolver;
     Endpoint endpoint;
     Timer timer;
 
 
     double timerPeriod(size_t ms);
     void onTimer(size_t);
-    void onPayload(int fd, const Payload& data);
+    void onPayload(int fd, PayloadSpan batch);
     void onConnect(int fd);
     void onDisconnect(int fd);
 
@@ -9,6 +9,8 @@
 #include "utils.h"
 
 #include <cstring>
+#include <algorithm>
+#include <pthread.h>
 #include <sys/epoll.h>
 
 namespace slick {
@@ -18,8 +20,15 @@ namespace slick {
 /******************************************************************************/
 
 Epoll::
-Epoll() : nextEvent(0), numEvents(0)
+Epoll(size_t maxEvents) :
+    spinBudget(0),
+    events(std::min<size_t>(MinEvents, maxEvents)),
+    maxEvents_(maxEvents), sparseBatches(0),
+    nextEvent(0), numEvents(0)
 {
+    assert(maxEvents > 0);
+    std::memset(&spinStats_, 0, sizeof spinStats_);
+
     fd_ = epoll_create(1);
     SLICK_CHECK_ERRNO(fd_ != -1, "Epoll.epoll_create");
 }
@@ -45,6 +54,34 @@ add(int fd, int flags)
     SLICK_CHECK_ERRNO(ret != -1, "Epoll.epoll_ctl.add");
 }
 
+void
+Epoll::
+add(int fd, uint64_t data, int flags)
+{
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof ev);
+
+    ev.data.u64 = data;
+    ev.events = flags;
+
+    int ret = epoll_ctl(fd_, EPOLL_CTL_ADD, fd, &ev);
+    SLICK_CHECK_ERRNO(ret != -1, "Epoll.epoll_ctl.add");
+}
+
+void
+Epoll::
+mod(int fd, uint64_t data, int flags)
+{
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof ev);
+
+    ev.data.u64 = data;
+    ev.events = flags;
+
+    int ret = epoll_ctl(fd_, EPOLL_CTL_MOD, fd, &ev);
+    SLICK_CHECK_ERRNO(ret != -1, "Epoll.epoll_ctl.mod");
+}
+
 
 void
 Epoll::
@@ -55,29 +92,96 @@ del(int fd)
 }
 
 
-struct epoll_event
+void
 Epoll::
-next()
+maxEvents(size_t events)
 {
-    while (!poll(-1));
-    return events[nextEvent++];
+    assert(events > 0);
+    assert(!pending());
+
+    maxEvents_ = events;
+    if (this->events.size() > maxEvents_) this->events.resize(maxEvents_);
 }
 
 bool
 Epoll::
-poll(int timeoutMs)
+refill(int timeoutMs)
 {
-    while (nextEvent == numEvents) {
-        int n = epoll_wait(fd_, events, MaxEvents, timeoutMs);
-        if (n < 0 && errno == EINTR) continue;
-        SLICK_CHECK_ERRNO(n >= 0, "Epoll.epoll_wait");
+    // Safe to do here since the last batch has been handed out.
+    resize();
 
-        numEvents = n;
-        nextEvent = 0;
-        break;
+    int n;
+    do n = wait(timeoutMs);
+    while (n < 0 && errno == EINTR);
+    SLICK_CHECK_ERRNO(n >= 0, "Epoll.epoll_wait");
+
+    numEvents = n;
+    nextEvent = 0;
+    return n > 0;
+}
+
+/** Sized on the last batch: a full batch means that events were left behind
+    in the kernel and will cost an extra wait.
+ */
+void
+Epoll::
+resize()
+{
+    size_t size = events.size();
+
+    if (numEvents == size && size < maxEvents_) {
+        events.resize(std::min(size * 2, maxEvents_));
+        sparseBatches = 0;
+    }
+
+    else if (numEvents < size / 4 && size > MinEvents) {
+        if (++sparseBatches < ShrinkAfter) return;
+
+        events.resize(size / 2);
+        events.shrink_to_fit();
+        sparseBatches = 0;
     }
 
-    return nextEvent < numEvents;
+    else sparseBatches = 0;
+}
+
+int
+Epoll::
+wait(int timeoutMs)
+{
+    if (!spinBudget || !timeoutMs)
+        return epoll_wait(fd_, events.data(), events.size(), timeoutMs);
+
+    double start = monotonicTime();
+    double now = start;
+    int n;
+
+    do {
+        n = epoll_wait(fd_, events.data(), events.size(), 0);
+        now = monotonicTime();
+    } while (!n && now - start < spinBudget);
+
+    spinStats_.spinning += now - start;
+    if (n) {
+        if (n > 0) spinStats_.spinWakeups++;
+        return n;
+    }
+
+    // The spin counts against the timeout so that callers don't end up
+    // waiting for longer than they asked for.
+    int elapsedMs = (now - start) * 1000;
+    if (timeoutMs > 0 && elapsedMs >= timeoutMs) return 0;
+    int remainingMs = timeoutMs > 0 ? timeoutMs - elapsedMs : timeoutMs;
+
+    n = epoll_wait(fd_, events.data(), events.size(), remainingMs);
+
+    // Saved before the clock gets a chance to clobber it.
+    int err = errno;
+    spinStats_.blocking += monotonicTime() - now;
+    if (n > 0) spinStats_.blockWakeups++;
+
+    errno = err;
+    return n;
 }
 
 
@@ -95,22 +199,82 @@ add(    int fd,
     assert(fd);
     assert(sourceFn);
 
-    sources[fd] = { sourceFn, startFn, stopFn };
-    poller.add(fd);
+    auto fn = [] (void* object, int, uint32_t) {
+        static_cast<Source*>(object)->sourceFn();
+    };
+
+    std::unique_ptr<Source> source(new Source);
+    source->pollSource = PollSource(fd, source.get(), fn);
+    source->sourceFn = sourceFn;
+    source->startFn = startFn;
+    source->stopFn = stopFn;
+
+    poller.add(fd, uint64_t(&source->pollSource), EPOLLIN);
+    retire(fd);
+    sources[fd] = std::move(source);
+}
+
+void
+SourcePoller::
+add(    const PollSource& pollSource,
+        const StartPollingFn& startFn,
+        const StopPollingFn& stopFn)
+{
+    assert(pollSource.fd);
+
+    std::unique_ptr<Source> source(new Source);
+    source->pollSource = pollSource;
+    source->startFn = startFn;
+    source->stopFn = stopFn;
+
+    poller.add(pollSource.fd, uint64_t(&source->pollSource), EPOLLIN);
+    retire(pollSource.fd);
+    sources[pollSource.fd] = std::move(source);
 }
 
 void
 SourcePoller::
-del(int fd) { sources.erase(fd); }
+del(int fd)
+{
+    if (!sources.count(fd)) return;
+
+    poller.del(fd);
+    retire(fd);
+}
+
+/** An fd that was closed without being removed can be reused by a new source
+    while the old one still has events in the current batch so it goes through
+    here as well.
+ */
+void
+SourcePoller::
+retire(int fd)
+{
+    auto it = sources.find(fd);
+    if (it == sources.end()) return;
+
+    // Events of the current batch for the source are ignored from now on.
+    auto& source = *it->second;
+    source.pollSource.fn = [] (void*, int, uint32_t) {};
+
+    retired.emplace_back(std::move(it->second));
+    sources.erase(it);
+}
 
 void
 SourcePoller::
 poll(size_t timeout)
 {
-    while (poller.poll(timeout)) {
+    // A single batch per call so that callers get a chance to stop polling
+    // even when periodic sources never let the poller go quiet.
+    if (!poller.poll(timeout)) return;
+
+    do {
         struct epoll_event ev = poller.next();
-        sources[ev.data.fd].sourceFn();
-    }
+        PollSource::cast(ev)(ev.events);
+    } while (poller.pending());
+
+    retired.clear();
 }
 
 void
@@ -118,8 +282,8 @@ SourcePoller::
 startPolling()
 {
     for (const auto& source : sources)
-        if (source.second.startFn)
-            source.second.startFn();
+        if (source.second->startFn)
+            source.second->startFn();
 }
 
 void
@@ -127,8 +291,8 @@ SourcePoller::
 stopPolling()
 {
     for (const auto& source : sources)
-        if (source.second.stopFn)
-            source.second.stopFn();
+        if (source.second->stopFn)
+            source.second->stopFn();
 }
 
 
@@ -136,6 +300,16 @@ stopPolling()
 /* POLL THREAD                                                                */
 /******************************************************************************/
 
+void pinThread(std::thread& th, int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    errno = pthread_setaffinity_np(th.native_handle(), sizeof set, &set);
+    SLICK_CHECK_ERRNO(!errno, "pthread_setaffinity_np");
+}
+
 void
 PollThread::
 run()
@@ -146,6 +320,10 @@ run()
                 while(!isDone) poll(100);
                 stopPolling();
             });
+
+    // Done from here so that errors are reported to the caller. The thread
+    // only spends a few polls on whatever cpu it started on.
+    if (cpu >= 0) pinThread(th, cpu);
 }
 
 void
@@ -10,10 +10,13 @@
 #include "lockless/tls.h"
 
 #include <thread>
+#include <memory>
 #include <atomic>
 #include <functional>
 #include <cassert>
+#include <cstdint>
 #include <unordered_map>
+#include <vector>
 #include <sys/epoll.h>
 
 namespace slick {
@@ -22,31 +25,124 @@ namespace slick {
 /* EPOLL                                                                      */
 /******************************************************************************/
 
+/** The event array starts out small and doubles whenever a wait fills it up
+    to a maximum. A long run of mostly empty batches halves it again so that a
+    burst doesn't pin the memory for good.
+ */
 struct Epoll
 {
-    Epoll();
+    enum {
+        MinEvents = 1U << 4,
+        DefaultMaxEvents = 1U << 10,
+    };
+
+    explicit Epoll(size_t maxEvents = DefaultMaxEvents);
     ~Epoll();
 
     Epoll(const Epoll&) = delete;
     Epoll& operator=(const Epoll&) = delete;
 
     void add(int fd, int flags = EPOLLIN);
+    void add(int fd, uint64_t data, int flags);
+    void mod(int fd, uint64_t data, int flags);
     void del(int fd);
-    struct epoll_event next();
-    bool poll(int timeoutMs = 0);
+
+    struct epoll_event next()
+    {
+        if (!pending()) while (!refill(-1));
+        return events[nextEvent++];
+    }
+
+    // Only goes to the kernel once every event of the last batch was handed
+    // out by next.
+    bool poll(int timeoutMs = 0)
+    {
+        return pending() || refill(timeoutMs);
+    }
+
+    // Whether events of the last batch are still waiting to be handled.
+    bool pending() const { return nextEvent < numEvents; }
 
     int fd() const { return fd_; }
 
+    // Must not be called while events are pending.
+    void maxEvents(size_t events);
+    size_t batchSize() const { return events.size(); }
+
+    /** Low latency mode where a blocking poll first spins on non-blocking
+        waits for up to the given budget before falling back to a blocking
+        wait for whatever is left of its timeout. Trades a core for the
+        wakeup latency of the scheduler. A budget of 0 disables it which is
+        the default.
+     */
+    void spin(size_t budgetUs) { spinBudget = budgetUs / 1e6; }
+
+    struct SpinStats
+    {
+        double spinning;      // Seconds spent in non-blocking waits.
+        double blocking;      // Seconds spent in blocking waits.
+        size_t spinWakeups;   // Batches picked up while spinning.
+        size_t blockWakeups;  // Batches picked up after blocking.
+    };
+
+    // Only tracked while spinning is enabled.
+    const SpinStats& spinStats() const { return spinStats_; }
+
 private:
+    bool refill(int timeoutMs);
+    int wait(int timeoutMs);
+    void resize();
+
     int fd_;
 
-    enum { MaxEvents = 1U << 4 };
-    struct epoll_event events[MaxEvents];
+    double spinBudget;
+    SpinStats spinStats_;
+
+    enum { ShrinkAfter = 1U << 8 };
+
+    std::vector<struct epoll_event> events;
+    size_t maxEvents_;
+    size_t sparseBatches;
+
     size_t nextEvent;
     size_t numEvents;
 };
 
 
+/******************************************************************************/
+/* POLL SOURCE                                                                */
+/******************************************************************************/
+
+/** Stable handle for whatever reacts to the events of an fd. Its address is
+    what gets registered in epoll_event.data.ptr so it must stay put for as
+    long as it's registered.
+
+    Unlike std::function it never allocates and calling it is a single
+    indirect call through a plain function pointer which is usually a
+    captureless lambda that casts the object back to its type.
+ */
+struct alignas(8) PollSource
+{
+    typedef void (*Fn) (void* object, int fd, uint32_t events);
+
+    PollSource() : fn(nullptr), object(nullptr), fd(-1) {}
+    PollSource(int fd, void* object, Fn fn) :
+        fn(fn), object(object), fd(fd)
+    {}
+
+    void operator() (uint32_t events) const { fn(object, fd, events); }
+
+    static PollSource& cast(const struct epoll_event& ev)
+    {
+        return *static_cast<PollSource*>(ev.data.ptr);
+    }
+
+    Fn fn;
+    void* object;
+    int fd;
+};
+
+
 /******************************************************************************/
 /* START POLLING                                                              */
 /******************************************************************************/
@@ -149,16 +245,20 @@ struct SourcePoller
     void startPolling();
     void stopPolling();
 
+    // See Epoll::maxEvents and Epoll::spin.
+    void maxEvents(size_t events) { poller.maxEvents(events); }
+    void spin(size_t budgetUs) { poller.spin(budgetUs); }
+    const Epoll::SpinStats& spinStats() const { return poller.spinStats(); }
+
     template<typename T>
     void add(T& source)
     {
-        T* pSource = &source;
-
-        auto sourceFn = [=] { pSource->poll(); };
-        auto startFn = startPollingFn(source);
-        auto stopFn = stopPollingFn(source);
+        auto fn = [] (void* object, int, uint32_t) {
+            static_cast<T*>(object)->poll();
+        };
 
-        add(source.fd(), sourceFn, startFn, stopFn);
+        add(PollSource(source.fd(), &source, fn),
+                startPollingFn(source), stopPollingFn(source));
     }
 
     void add(int fd,
@@ -173,13 +273,24 @@ struct SourcePoller
 private:
     Epoll poller;
 
-    struct Callbacks
+    struct Source
     {
+        PollSource pollSource;
         SourceFn sourceFn;
         StartPollingFn startFn;
         StopPollingFn stopFn;
     };
-    std::unordered_map<int, Callbacks> sources;
+
+    void add(const PollSource& pollSource,
+            const StartPollingFn& startFn, const StopPollingFn& stopFn);
+    void retire(int fd);
+
+    // Sources are boxed so that the handles registered with epoll don't move.
+    std::unordered_map<int, std::unique_ptr<Source> > sources;
+
+    // Removed sources may still have events in the current batch so they're
+    // kept around until it's done with.
+    std::vector<std::unique_ptr<Source> > retired;
 };
 
 
@@ -236,18 +347,26 @@ protected:
 /* POLL THREAD                                                                */
 /******************************************************************************/
 
-// EXTREMELY simple poll thread. Mostly useful for tests.
+void pinThread(std::thread& th, int cpu);
+
+// EXTREMELY simple poll thread. Mostly useful for tests. See PollPool for
+// something that spreads the load over multiple threads.
 struct PollThread : public SourcePoller
 {
-    PollThread() : isDone(true) {}
+    PollThread() : isDone(true), cpu(-1) {}
     ~PollThread() { join(); }
 
+    // Pins the thread to a cpu which goes hand in hand with spinning. Must be
+    // called before run.
+    void pin(int cpu) { this->cpu = cpu; }
+
     void run();
     void join();
 
 private:
     std::thread th;
     std::atomic<bool> isDone;
+    int cpu;
 };
 
 
@@ -0,0 +1,358 @@
+/* poll_pool.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   PollPool implementation
+*/
+
+#include "poll_pool.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <sys/epoll.h>
+
+namespace slick {
+
+
+/******************************************************************************/
+/* WORKER                                                                     */
+/******************************************************************************/
+
+/** Can be called from any thread since one-shot hands each ready source to a
+    single caller until it's rearmed.
+ */
+size_t
+PollPool::Worker::
+pollShared()
+{
+    struct epoll_event events[StealBatch];
+
+    int n = epoll_wait(shared.fd(), events, StealBatch, 0);
+    if (n < 0 && errno == EINTR) return 0;
+    SLICK_CHECK_ERRNO(n >= 0, "PollPool.epoll_wait");
+
+    for (int i = 0; i < n; ++i) {
+        auto& source = PollSource::cast(events[i]);
+        source(events[i].events);
+        shared.mod(source.fd, uint64_t(&source), EPOLLIN | EPOLLONESHOT);
+    }
+
+    return n;
+}
+
+/** Threads that aren't dispatching get to their own ready sources soon
+    enough so only the ones that are get stolen from.
+ */
+bool
+PollPool::Worker::
+steal(Worker& victim)
+{
+    if (!victim.dispatching) return false;
+
+    double start = monotonicTime();
+
+    size_t n = victim.pollShared();
+    if (!n) return false;
+
+    busy = busy + (monotonicTime() - start);
+    stolen += n;
+    return true;
+}
+
+
+/******************************************************************************/
+/* POLL POOL                                                                  */
+/******************************************************************************/
+
+PollPool::
+PollPool(size_t threads) :
+    isDone(true)
+{
+    // hardware_concurrency is allowed to give up.
+    threads = std::max<size_t>(threads, 1);
+
+    stopSource = PollSource(stop.fd(), this, [] (void*, int, uint32_t) {});
+
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(new Worker);
+        Worker& worker = *workers.back();
+
+        worker.sharedSource = PollSource(worker.shared.fd(), &worker,
+                [] (void* worker, int, uint32_t) {
+                    static_cast<Worker*>(worker)->pollShared();
+                });
+
+        worker.poller.add(
+                worker.shared.fd(), uint64_t(&worker.sharedSource), EPOLLIN);
+        worker.poller.add(stop.fd(), uint64_t(&stopSource), EPOLLIN);
+    }
+
+    if (workers.size() < 2) return;
+
+    // Edge-triggered so that we're only woken up when something new is
+    // ready and not for as long as the victim takes to get to it.
+    for (size_t i = 0; i < workers.size(); ++i) {
+        Worker& worker = *workers[i];
+        worker.victim = workers[(i + workers.size() - 1) % workers.size()].get();
+
+        worker.victimSource = PollSource(worker.victim->shared.fd(), &worker,
+                [] (void* object, int, uint32_t) {
+                    auto& worker = *static_cast<Worker*>(object);
+                    worker.steal(*worker.victim);
+                });
+
+        worker.poller.add(worker.victim->shared.fd(),
+                uint64_t(&worker.victimSource), EPOLLIN | EPOLLET);
+
+        worker.kickSource = PollSource(worker.kick.fd(), &worker,
+                [] (void* object, int, uint32_t) {
+                    auto& worker = *static_cast<Worker*>(object);
+                    worker.kick.poll();
+                    worker.steal(*worker.victim);
+                });
+
+        worker.poller.add(
+                worker.kick.fd(), uint64_t(&worker.kickSource), EPOLLIN);
+    }
+}
+
+PollPool::
+~PollPool()
+{
+    join();
+}
+
+void
+PollPool::
+pin(size_t thread, int cpu)
+{
+    assert(isDone);
+    assert(thread < workers.size());
+    workers[thread]->cpu = cpu;
+}
+
+size_t
+PollPool::
+add(    int fd,
+        const SourceFn& sourceFn,
+        const StartPollingFn& startFn,
+        const StopPollingFn& stopFn)
+{
+    assert(sourceFn);
+
+    auto fn = [] (void* object, int, uint32_t) {
+        static_cast<Source*>(object)->sourceFn();
+    };
+
+    std::unique_ptr<Source> source(new Source);
+    source->pollSource = PollSource(fd, source.get(), fn);
+    source->sourceFn = sourceFn;
+    source->startFn = startFn;
+    source->stopFn = stopFn;
+
+    return add(std::move(source));
+}
+
+size_t
+PollPool::
+add(    const PollSource& pollSource,
+        const StartPollingFn& startFn,
+        const StopPollingFn& stopFn)
+{
+    std::unique_ptr<Source> source(new Source);
+    source->pollSource = pollSource;
+    source->startFn = startFn;
+    source->stopFn = stopFn;
+
+    return add(std::move(source));
+}
+
+size_t
+PollPool::
+add(std::unique_ptr<Source> source)
+{
+    assert(isDone);
+
+    int fd = source->pollSource.fd;
+    assert(fd >= 0);
+    assert(!sources.count(fd));
+
+    size_t thread = leastLoaded();
+    Worker& worker = *workers[thread];
+    source->thread = thread;
+    source->stealable = !source->startFn && !source->stopFn;
+
+    uint64_t data = uint64_t(&source->pollSource);
+    if (source->stealable) worker.shared.add(fd, data, EPOLLIN | EPOLLONESHOT);
+    else worker.poller.add(fd, data, EPOLLIN);
+
+    worker.sources++;
+    sources[fd] = std::move(source);
+    return thread;
+}
+
+void
+PollPool::
+del(int fd)
+{
+    assert(isDone);
+
+    auto it = sources.find(fd);
+    if (it == sources.end()) return;
+
+    const Source& source = *it->second;
+    Worker& worker = *workers[source.thread];
+
+    if (source.stealable) worker.shared.del(fd);
+    else worker.poller.del(fd);
+
+    worker.sources--;
+    sources.erase(it);
+}
+
+void
+PollPool::
+run()
+{
+    assert(isDone);
+    isDone = false;
+
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i]->th = std::thread([=] { work(i); });
+
+    // Done from here so that errors are reported to the caller.
+    for (auto& worker : workers)
+        if (worker->cpu >= 0) pinThread(worker->th, worker->cpu);
+}
+
+void
+PollPool::
+join()
+{
+    if (isDone) return;
+    isDone = true;
+
+    stop.signal();
+    for (auto& worker : workers) worker->th.join();
+    stop.poll();
+}
+
+/** Sources are assumed to cost the same on average so the time spent
+    dispatching by each thread is spread over the sources it had. Before the
+    pool ever ran, this comes down to the number of sources.
+ */
+size_t
+PollPool::
+leastLoaded() const
+{
+    double busy = 0;
+    size_t sources = 0;
+    for (const auto& worker : workers) {
+        busy += worker->busy;
+        sources += worker->sources;
+    }
+
+    double cost = sources ? busy / sources : 0;
+    auto load = [=] (const Worker& worker) {
+        if (!cost) return double(worker.sources);
+        return worker.busy + worker.sources * cost;
+    };
+
+    size_t thread = 0;
+    for (size_t i = 1; i < workers.size(); ++i) {
+        if (load(*workers[i]) < load(*workers[thread]))
+            thread = i;
+    }
+
+    return thread;
+}
+
+auto
+PollPool::
+stats(size_t thread) const -> Stats
+{
+    assert(thread < workers.size());
+    const Worker& worker = *workers[thread];
+
+    Stats stats;
+    stats.sources = worker.sources;
+    stats.batches = worker.batches;
+    stats.stolen = worker.stolen;
+    stats.busy = worker.busy;
+    return stats;
+}
+
+void
+PollPool::
+work(size_t id)
+{
+    Worker& worker = *workers[id];
+
+    // The sources can't change while we're running so it's safe to read.
+    for (const auto& source : sources) {
+        if (source.second->thread == id && source.second->startFn)
+            source.second->startFn();
+    }
+
+    bool stole = false;
+
+    while (!isDone) {
+
+        // Keep going without blocking for as long as there's work to steal.
+        if (!worker.poller.poll(stole ? 0 : -1)) {
+            stole = steal(id);
+            continue;
+        }
+
+        worker.dispatching = true;
+        double start = monotonicTime();
+
+        // Our watcher ignored any edge it saw before we started dispatching
+        // so it has to be told when ready sources might be stuck behind the
+        // rest of the batch.
+        struct epoll_event ev = worker.poller.next();
+        if (worker.poller.pending() && workers.size() > 1
+                && &PollSource::cast(ev) != &worker.sharedSource)
+        {
+            workers[(id + 1) % workers.size()]->kick.signal();
+        }
+
+        while (true) {
+            PollSource::cast(ev)(ev.events);
+            if (!worker.poller.pending()) break;
+            ev = worker.poller.next();
+        }
+
+        worker.busy = worker.busy + (monotonicTime() - start);
+        worker.batches++;
+        worker.dispatching = false;
+
+        // Freed up so see if anyone else is stuck.
+        stole = steal(id);
+    }
+
+    for (const auto& source : sources) {
+        if (source.second->thread == id && source.second->stopFn)
+            source.second->stopFn();
+    }
+}
+
+/** Only looks at flags until a thread that's dispatching is found so it's
+    cheap enough to do after every batch.
+ */
+bool
+PollPool::
+steal(size_t id)
+{
+    Worker& worker = *workers[id];
+
+    for (size_t i = 1; i < workers.size(); ++i) {
+        if (worker.steal(*workers[(id + i) % workers.size()]))
+            return true;
+    }
+
+    return false;
+}
+
+} // slick
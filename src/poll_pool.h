@@ -0,0 +1,166 @@
+/* poll_pool.h                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Multi-threaded pool of pollers.
+*/
+
+#pragma once
+
+#include "poll.h"
+#include "notify.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+namespace slick {
+
+
+/******************************************************************************/
+/* POLL POOL                                                                  */
+/******************************************************************************/
+
+/** Spreads sources over a set of threads that each poll their own epoll.
+    Sources are assigned when added to the thread with the least load which
+    is estimated from the time each thread spent dispatching in earlier runs
+    and from its number of sources.
+
+    Sources that don't need to know which thread polls them, those without
+    startPolling or stopPolling, are stealable: they're registered one-shot in
+    a second epoll of their thread which other threads can poll to take over
+    ready sources from a thread stuck dispatching. One-shot ensures that a
+    source is never polled by two threads at once. Thread-aware sources like
+    endpoints always stay on their thread.
+
+    Each thread watches the stealable sources of the thread before it through
+    an edge-triggered registration of its epoll so that it only wakes up when
+    new sources become ready. A thread that starts dispatching a batch with
+    stealable sources stuck behind other work also kicks its watcher. Threads
+    steal only from threads that are dispatching and otherwise block until
+    they have something to do so a quiet pool stays off the kernel.
+
+    Sources must be added and removed while the pool isn't running.
+ */
+struct PollPool
+{
+    typedef std::function<void()> SourceFn;
+
+    explicit PollPool(size_t threads = std::thread::hardware_concurrency());
+    ~PollPool();
+
+    PollPool(const PollPool&) = delete;
+    PollPool& operator=(const PollPool&) = delete;
+
+    size_t threads() const { return workers.size(); }
+
+    // Must be called before run.
+    void pin(size_t thread, int cpu);
+
+    // Returns the thread that the source was assigned to.
+    template<typename T>
+    size_t add(T& source)
+    {
+        auto fn = [] (void* object, int, uint32_t) {
+            static_cast<T*>(object)->poll();
+        };
+
+        return add(PollSource(source.fd(), &source, fn),
+                startPollingFn(source), stopPollingFn(source));
+    }
+
+    size_t add(int fd,
+            const SourceFn& sourceFn,
+            const StartPollingFn& startFn = {},
+            const StopPollingFn& stopFn = {});
+
+    template<typename T>
+    void del(T& source) { del(source.fd()); }
+    void del(int fd);
+
+    void run();
+    void join();
+
+    struct Stats
+    {
+        size_t sources;
+        size_t batches;   // Batches of events dispatched from its own epoll.
+        size_t stolen;    // Events stolen from other threads.
+        double busy;      // Seconds spent dispatching.
+    };
+
+    // Counters are updated by the threads while running.
+    Stats stats(size_t thread) const;
+
+private:
+
+    enum { StealBatch = 1U << 4 };
+
+    struct Source
+    {
+        PollSource pollSource;
+        SourceFn sourceFn;
+        StartPollingFn startFn;
+        StopPollingFn stopFn;
+
+        size_t thread;
+        bool stealable;
+    };
+
+    struct Worker
+    {
+        Worker() :
+            cpu(-1), sources(0), dispatching(false),
+            batches(0), stolen(0), busy(0), victim(nullptr)
+        {}
+
+        Epoll poller;
+
+        // Holds the stealable sources. Registered with poller.
+        Epoll shared;
+        PollSource sharedSource;
+
+        std::thread th;
+        int cpu;
+        size_t sources;
+
+        std::atomic<bool> dispatching;
+        std::atomic<size_t> batches;
+        std::atomic<size_t> stolen;
+        std::atomic<double> busy;
+
+        // The thread whose stealable sources we watch.
+        Worker* victim;
+        PollSource victimSource;
+
+        // Written by the victim when it has work for us.
+        Notify kick;
+        PollSource kickSource;
+
+        size_t pollShared();
+        bool steal(Worker& victim);
+    };
+
+    size_t add(const PollSource& pollSource,
+            const StartPollingFn& startFn, const StopPollingFn& stopFn);
+    size_t add(std::unique_ptr<Source> source);
+
+    size_t leastLoaded() const;
+    void work(size_t id);
+    bool steal(size_t id);
+
+    std::vector<std::unique_ptr<Worker> > workers;
+    std::unordered_map<int, std::unique_ptr<Source> > sources;
+
+    std::atomic<bool> isDone;
+
+    // Level-triggered and registered with every thread so that a single
+    // signal wakes them all up.
+    Notify stop;
+    PollSource stopSource;
+};
+
+} // slick
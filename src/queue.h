@@ -2,18 +2,17 @@
    Rémi Attab (remi.attab@gmail.com), 30 Nov 2013
    FreeBSD-style copyright and disclaimer apply
 
-   Partially lock-free queue specialized for the defer mechanism.
+   Lock-free queue specialized for the defer mechanism.
 */
 
 #pragma once
 
 #include "utils.h"
-#include "lockless/lock.h"
+#include "lockless/arch.h"
 
 #include <array>
 #include <atomic>
 #include <utility>
-#include <mutex>
 #include <cassert>
 
 namespace slick {
@@ -23,70 +22,106 @@ namespace slick {
 /* QUEUE                                                                      */
 /******************************************************************************/
 
+/** Bounded multi-producer single-consumer queue.
+
+    Every slot carries a sequence number which tells the producers whether the
+    slot is free for the current lap and tells the consumer whether the value
+    has been written. Producers claim a slot with a single CAS on the write
+    cursor and publish it by bumping the slot's sequence so there's no lock
+    anywhere. The read cursor is only ever touched by the consumer.
+
+    emplace() only consumes its arguments if it succeeds which means that a
+    rejected value can be handed back to the caller without a copy.
+ */
 template<typename T, size_t Size>
 struct Queue
 {
-    Queue() { d.cursors = 0; }
+    static_assert(Size && !(Size & (Size - 1)), "Size must be a power of 2");
+
+    Queue() : write(0), read(0)
+    {
+        for (size_t i = 0; i < Size; ++i)
+            queue[i].seq.store(i, std::memory_order_relaxed);
+    }
 
     Queue(const Queue&) = delete;
     Queue& operator=(const Queue&) = delete;
 
     constexpr size_t capacity() const { return Size; }
 
+    // Only an estimate when called outside the consumer thread.
     size_t size() const
     {
-        uint64_t all = d.cursors;
-        return wpos(all) - rpos(all);
+        return write.load(std::memory_order_acquire) - read;
     }
 
+    // Only reliable when called from the consumer thread.
     bool empty() const
     {
-        uint64_t all = d.cursors;
-        return wpos(all) == rpos(all);
+        auto& cell = queue[read % Size];
+        return cell.seq.load(std::memory_order_acquire) != read + 1;
     }
 
     T pop()
     {
         assert(!empty());
 
-        uint32_t pos = d.split.read % Size;
-        T val = std::move(queue[pos]);
+        auto& cell = queue[read % Size];
+        T val = std::move(cell.value);
 
-        d.split.read++;
-        return std::move(val);
+        // Frees the slot for the producers of the next lap.
+        cell.seq.store(read + Size, std::memory_order_release);
+        read++;
+
+        return val;
     }
 
-    template<typename Val>
-    bool push(Val&& val)
+    template<typename... Args>
+    bool emplace(Args&&... args)
     {
-        std::lock_guard<Lock> guard(lock);
-
-        uint64_t old = d.cursors;
-        if (wpos(old) - rpos(old) == Size) return false;
-
-        queue[wpos(old) % Size] = std::forward<Val>(val);
-        d.split.write++; // should act as a release barrier.
+        size_t pos = write.load(std::memory_order_relaxed);
+        Cell* cell;
+
+        while (true) {
+            cell = &queue[pos % Size];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            auto diff = intptr_t(seq) - intptr_t(pos);
+
+            if (!diff) {
+                if (write.compare_exchange_weak(
+                                pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0) return false; // The consumer is a lap behind.
+            else pos = write.load(std::memory_order_relaxed);
+        }
+
+        cell->value = T(std::forward<Args>(args)...);
+        cell->seq.store(pos + 1, std::memory_order_release);
 
         return true;
     }
 
-private:
-
-    uint32_t rpos(uint64_t all) const { return all; }
-    uint32_t wpos(uint64_t all) const { return all >> 32; }
-
-    union {
-        struct {
-            std::atomic<uint32_t> read;
-            std::atomic<uint32_t> write;
-        } split;
-        std::atomic<uint64_t> cursors;
-    } d;
+    template<typename Val>
+    bool push(Val&& val)
+    {
+        return emplace(std::forward<Val>(val));
+    }
 
-    typedef lockless::UnfairLock Lock;
+private:
 
-    Lock lock;
-    std::array<T, Size> queue;
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    // Padded instead of aligned so that the owners don't need aligned new.
+    std::atomic<size_t> write;
+    uint8_t pad0[lockless::CacheLine - sizeof(std::atomic<size_t>)];
+    size_t read;
+    uint8_t pad1[lockless::CacheLine - sizeof(size_t)];
+    std::array<Cell, Size> queue;
 };
 
 
@@ -0,0 +1,173 @@
+/* recv_buffer.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Receive buffer implementation.
+*/
+
+#include "recv_buffer.h"
+
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+namespace slick {
+
+/******************************************************************************/
+/* RECV BUFFER                                                                */
+/******************************************************************************/
+
+RecvBuffer::
+RecvBuffer(size_t capacity) :
+    capacity(capacity), slab(nullptr), head(0), tail(0),
+    threshold(0), streamTotal(0), streamLeft(0)
+{}
+
+RecvBuffer::
+~RecvBuffer()
+{
+    if (slab) slab->release();
+}
+
+RecvBuffer::
+RecvBuffer(RecvBuffer&& other) noexcept :
+    capacity(other.capacity), slab(other.slab), head(other.head), tail(other.tail),
+    threshold(other.threshold),
+    streamTotal(other.streamTotal), streamLeft(other.streamLeft)
+{
+    other.slab = nullptr;
+    other.head = other.tail = 0;
+    other.streamTotal = other.streamLeft = 0;
+}
+
+RecvBuffer&
+RecvBuffer::
+operator=(RecvBuffer&& other) noexcept
+{
+    if (this == &other) return *this;
+
+    if (slab) slab->release();
+
+    capacity = other.capacity;
+    slab = other.slab;
+    head = other.head;
+    tail = other.tail;
+    threshold = other.threshold;
+    streamTotal = other.streamTotal;
+    streamLeft = other.streamLeft;
+
+    other.slab = nullptr;
+    other.head = other.tail = 0;
+    other.streamTotal = other.streamLeft = 0;
+
+    return *this;
+}
+
+
+size_t
+RecvBuffer::
+nextSize() const
+{
+    // The bytes of a streamed frame don't start with a header.
+    if (streaming() || pending() < sizeof(Payload::SizeT)) return 0;
+    auto header = *reinterpret_cast<const Payload::SizeT*>(slab->data() + head);
+    return header & ~Payload::ControlBit;
+}
+
+size_t
+RecvBuffer::
+frameSize() const
+{
+    if (streaming() || pending() < sizeof(Payload::SizeT)) return 0;
+    return sizeof(Payload::SizeT) + nextSize();
+}
+
+uint8_t*
+RecvBuffer::
+prepare()
+{
+    if (!slab) slab = Slab::alloc(capacity);
+
+    // Nothing left to keep around so we can start over for free.
+    if (!pending() && slab->unique()) head = tail = 0;
+
+    size_t frame = frameSize();
+    size_t needed = std::max(frame, pending() + 1);
+
+    if (tail < slab->capacity() && head + needed <= slab->capacity())
+        return slab->data() + tail;
+
+    relocate(frame);
+    return slab->data() + tail;
+}
+
+void
+RecvBuffer::
+relocate(size_t frame)
+{
+    size_t bytes = pending();
+
+    if (slab->unique() && frame <= slab->capacity())
+        std::memmove(slab->data(), slab->data() + head, bytes);
+
+    else {
+        Slab* newSlab = Slab::alloc(std::max<size_t>(capacity, frame));
+        std::memcpy(newSlab->data(), slab->data() + head, bytes);
+
+        slab->release();
+        slab = newSlab;
+    }
+
+    head = 0;
+    tail = bytes;
+}
+
+void
+RecvBuffer::
+commit(size_t bytes)
+{
+    tail += bytes;
+    assert(tail <= slab->capacity());
+}
+
+Payload
+RecvBuffer::
+next()
+{
+    size_t frame = frameSize();
+    if (!frame || pending() < frame) return Payload();
+    if (threshold && frame - sizeof(Payload::SizeT) > threshold) return Payload();
+
+    Payload data = Payload::view(slab, slab->data() + head);
+    head += frame;
+
+    return data;
+}
+
+PayloadChunk
+RecvBuffer::
+nextChunk()
+{
+    if (!streaming()) {
+        size_t size = nextSize();
+        if (!threshold || size <= threshold) return PayloadChunk();
+
+        head += sizeof(Payload::SizeT);
+        streamTotal = streamLeft = size;
+    }
+
+    PayloadChunk chunk;
+    chunk.size = std::min(pending(), streamLeft);
+    if (!chunk.size) return chunk;
+
+    chunk.data = slab->data() + head;
+    chunk.offset = streamTotal - streamLeft;
+    chunk.total = streamTotal;
+
+    head += chunk.size;
+    streamLeft -= chunk.size;
+
+    return chunk;
+}
+
+} // slick
@@ -0,0 +1,107 @@
+/* recv_buffer.h                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Persistent receive buffer for framed payloads.
+*/
+
+#pragma once
+
+#include "payload.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace slick {
+
+/******************************************************************************/
+/* PAYLOAD CHUNK                                                              */
+/******************************************************************************/
+
+/** Slice of a payload that is being streamed instead of buffered whole. The
+    data is only valid until the next read into the buffer.
+ */
+struct PayloadChunk
+{
+    PayloadChunk() : data(nullptr), size(0), offset(0), total(0) {}
+
+    const uint8_t* data;
+    size_t size;
+
+    size_t offset; // Position of the chunk within its payload.
+    size_t total;  // Size of the whole payload.
+
+    bool last() const { return offset + size == total; }
+    explicit operator bool() const { return size; }
+};
+
+
+/******************************************************************************/
+/* RECV BUFFER                                                                */
+/******************************************************************************/
+
+/** Per-connection receive buffer which hands out frames as payloads that point
+    directly into the buffer. Receiving a frame therefore doesn't require any
+    allocation or copy.
+
+    Bytes are read in at the tail of a slab and complete frames are consumed
+    from the head. A partial frame stays where it is across reads and is only
+    relocated once the slab runs out of room. If no one else is referencing the
+    slab then it gets compacted and reused, otherwise a new slab is allocated
+    and the old one is left to the payloads still pointing into it.
+ */
+struct RecvBuffer
+{
+    enum { DefaultCapacity = 1U << 14 };
+
+    explicit RecvBuffer(size_t capacity = DefaultCapacity);
+    ~RecvBuffer();
+
+    RecvBuffer(RecvBuffer&& other) noexcept;
+    RecvBuffer& operator=(RecvBuffer&& other) noexcept;
+
+    RecvBuffer(const RecvBuffer&) = delete;
+    RecvBuffer& operator=(const RecvBuffer&) = delete;
+
+    /** Makes room for the next read and returns where it should go. */
+    uint8_t* prepare();
+    size_t available() const { return slab ? slab->capacity() - tail : 0; }
+    void commit(size_t bytes);
+
+    /** Returns the next complete frame or an empty payload if there is none. */
+    Payload next();
+
+    /** Frames with more bytes than the threshold are streamed. 0 disables
+        streaming. Only affects frames whose header has yet to be read.
+     */
+    void streamThreshold(size_t bytes) { threshold = bytes; }
+
+    /** Returns whatever is available of the frame being streamed or an empty
+        chunk if there's no such frame. Should be called whenever next() comes
+        up empty.
+     */
+    PayloadChunk nextChunk();
+
+    bool streaming() const { return streamLeft; }
+
+    /** Size of the payload of the next frame or 0 if its header isn't in. */
+    size_t nextSize() const;
+
+    size_t pending() const { return tail - head; }
+
+private:
+
+    size_t frameSize() const;
+    void relocate(size_t capacity);
+
+    size_t capacity;
+    Slab* slab;
+    size_t head;
+    size_t tail;
+
+    size_t threshold;
+    size_t streamTotal;
+    size_t streamLeft;
+};
+
+} // slick
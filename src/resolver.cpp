@@ -0,0 +1,205 @@
+/* resolver.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Resolver implementation
+*/
+
+#include "resolver.h"
+#include "utils.h"
+
+#include <cassert>
+#include <arpa/inet.h>
+
+namespace slick {
+
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+namespace {
+
+// Numeric hosts are resolved without going to the network.
+bool isNumeric(const std::string& host)
+{
+    uint8_t buf[sizeof(struct in6_addr)];
+    return inet_pton(AF_INET, host.c_str(), buf) == 1
+        || inet_pton(AF_INET6, host.c_str(), buf) == 1;
+}
+
+SockAddrs tryResolve(const Address& addr)
+{
+    try { return resolve(addr); }
+    catch (const std::exception&) { return SockAddrs(); }
+}
+
+} // namespace anonymous
+
+
+/******************************************************************************/
+/* RESOLVER                                                                   */
+/******************************************************************************/
+
+constexpr double Resolver::DefaultTTL;
+
+Resolver::
+Resolver(double ttl) :
+    ttl_(ttl), evictSize(1 << 6), done(false)
+{
+    using namespace std::placeholders;
+    results.onOperation = std::bind(&Resolver::complete, this, _1, _2);
+
+    worker = std::thread([=] { run(); });
+}
+
+Resolver::
+~Resolver()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        done = true;
+    }
+    cond.notify_one();
+
+    // A lookup in progress can't be interrupted so this waits until it
+    // completes.
+    worker.join();
+}
+
+void
+Resolver::
+run()
+{
+    while (true) {
+        Address addr;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [&] { return done || !requests.empty(); });
+            if (done) return;
+
+            addr = std::move(requests.front());
+            requests.pop_front();
+        }
+
+        SockAddrs addrs = tryResolve(addr);
+
+        // Bails if the polling thread has gone away and the queue is full.
+        while (!results.tryDefer(std::move(addr), std::move(addrs))) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (done) return;
+            }
+            std::this_thread::yield();
+        }
+    }
+}
+
+void
+Resolver::
+poll()
+{
+    results.poll();
+}
+
+void
+Resolver::
+complete(Address&& addr, SockAddrs&& addrs)
+{
+    std::string key = addr.toString();
+
+    auto it = pending.find(key);
+    if (it == pending.end()) return;
+
+    std::vector<ResolveFn> callbacks = std::move(it->second);
+    pending.erase(it);
+
+    if (!addrs.empty() && ttl_ > 0) {
+        double now = monotonicTime();
+        if (cache.size() >= evictSize) evict(now);
+        cache[key] = Entry{ addrs, now + ttl_ };
+    }
+
+    for (const auto& fn : callbacks) fn(addrs);
+}
+
+/** Expired entries are only dropped on lookup so a full sweep is done every
+    time the cache doubles in size to keep hosts that are never looked up
+    again from piling up.
+ */
+void
+Resolver::
+evict(double now)
+{
+    for (auto it = cache.begin(); it != cache.end();) {
+        if (it->second.expiration <= now) it = cache.erase(it);
+        else ++it;
+    }
+
+    evictSize = std::max<size_t>(evictSize, cache.size() * 2);
+}
+
+void
+Resolver::
+resolve(const Address& addr, const ResolveFn& fn)
+{
+    assert(addr);
+
+    if (isNumeric(addr.host)) {
+        fn(tryResolve(addr));
+        return;
+    }
+
+    std::string key = addr.toString();
+
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+        if (it->second.expiration > monotonicTime()) {
+            fn(it->second.addrs);
+            return;
+        }
+        cache.erase(it);
+    }
+
+    auto& callbacks = pending[key];
+    callbacks.push_back(fn);
+    if (callbacks.size() > 1) return;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        requests.push_back(addr);
+    }
+    cond.notify_one();
+}
+
+void
+Resolver::
+connect(const Address& addr, const ConnectFn& fn)
+{
+    connect(NodeAddress{ addr }, 0, fn);
+}
+
+void
+Resolver::
+connect(const NodeAddress& node, const ConnectFn& fn)
+{
+    connect(node, 0, fn);
+}
+
+void
+Resolver::
+connect(const NodeAddress& node, size_t i, const ConnectFn& fn)
+{
+    if (i == node.size()) {
+        fn(Socket());
+        return;
+    }
+
+    resolve(node[i], [=] (const SockAddrs& addrs) {
+        Socket socket = Socket::connect(addrs);
+        if (socket) fn(std::move(socket));
+        else connect(node, i + 1, fn);
+    });
+}
+
+} // slick
@@ -0,0 +1,102 @@
+/* resolver.h                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Asynchronous name resolution.
+*/
+
+#pragma once
+
+#include "socket.h"
+#include "defer.h"
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+namespace slick {
+
+
+/******************************************************************************/
+/* RESOLVER                                                                   */
+/******************************************************************************/
+
+/** Resolves addresses without ever blocking the polling thread.
+
+    Numeric hosts are resolved on the spot and other hosts are handed off to a
+    worker thread whose results are picked up through fd(). Successful lookups
+    are cached for the ttl so that repeated connects to the same host complete
+    right away without any lookup. Concurrent lookups of the same address are
+    folded into a single one.
+
+    Callbacks are always invoked from the polling thread, either directly from
+    resolve() and connect() when the answer is already known or from poll().
+    Failed lookups are reported with an empty set of addresses and are never
+    cached.
+ */
+struct Resolver
+{
+    explicit Resolver(double ttl = DefaultTTL);
+    ~Resolver();
+
+    Resolver(const Resolver&) = delete;
+    Resolver& operator=(const Resolver&) = delete;
+
+    int fd() const { return results.fd(); }
+    void poll();
+
+    // Cache lifetime in seconds of a successful lookup.
+    void ttl(double seconds) { ttl_ = seconds; }
+
+    typedef std::function<void(const SockAddrs& addrs)> ResolveFn;
+    void resolve(const Address& addr, const ResolveFn& fn);
+
+    /** Connects to the first address of the node that resolves to a valid
+        socket which is invalid if every address failed.
+     */
+    typedef std::function<void(Socket&& socket)> ConnectFn;
+    void connect(const Address& addr, const ConnectFn& fn);
+    void connect(const NodeAddress& node, const ConnectFn& fn);
+
+    size_t cached() const { return cache.size(); }
+
+private:
+
+    static constexpr double DefaultTTL = 60;
+
+    void run();
+    void connect(const NodeAddress& node, size_t i, const ConnectFn& fn);
+    void complete(Address&& addr, SockAddrs&& addrs);
+    void evict(double now);
+
+    double ttl_;
+
+    struct Entry
+    {
+        SockAddrs addrs;
+        double expiration; // monotonicTime()
+    };
+    std::unordered_map<std::string, Entry> cache;
+    size_t evictSize;
+
+    // Callbacks waiting on a lookup in the worker.
+    std::unordered_map<std::string, std::vector<ResolveFn> > pending;
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<Address> requests;
+    bool done;
+
+    enum { ResultsSize = 1 << 6 };
+    Defer<ResultsSize, Address, SockAddrs> results;
+
+    std::thread worker;
+};
+
+} // slick
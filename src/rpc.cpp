@@ -0,0 +1,180 @@
+/* rpc.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Rpc implementation
+*/
+
+#include "rpc.h"
+
+namespace slick {
+
+
+/******************************************************************************/
+/* RPC                                                                        */
+/******************************************************************************/
+
+constexpr double Rpc::DefaultTimeout;
+constexpr Rpc::Msg::Type Rpc::Msg::Request;
+constexpr Rpc::Msg::Type Rpc::Msg::Response;
+constexpr Rpc::Msg::Type Rpc::Msg::Error;
+
+Rpc::
+Rpc(double timeout) :
+    timeout_(timeout), nextId(1)
+{
+    init();
+}
+
+Rpc::
+Rpc(Port listenPort, double timeout) :
+    timeout_(timeout), nextId(1), endpoint(listenPort)
+{
+    init();
+}
+
+Rpc::
+~Rpc()
+{
+    // The endpoint outlives the deadlines and would otherwise fail the calls
+    // of its connections into a half destroyed object.
+    endpoint.onLostConnection = Endpoint::ConnectionFn();
+    endpoint.onDroppedPayload = Endpoint::PayloadFn();
+}
+
+void
+Rpc::
+init()
+{
+    using namespace std::placeholders;
+
+    endpoint.onPayload = bind(&Rpc::onPayload, this, _1, _2);
+    endpoint.onDroppedPayload = bind(&Rpc::onDroppedPayload, this, _1, _2);
+    endpoint.onLostConnection = bind(&Rpc::onDisconnect, this, _1);
+    endpoint.onNewConnection = [=] (int fd) {
+        if (onNewConnection) onNewConnection(fd);
+    };
+    poller.add(endpoint);
+
+    deadlines.onTimeout = [=] (CallId id) { complete(id, Status::Timeout); };
+    poller.add(deadlines);
+}
+
+auto
+Rpc::
+send(int fd, CallId id, Payload&& data, DoneFn done, double timeout) -> CallId
+{
+    if (fd <= 0) return 0;
+
+    calls[id] = Call{ fd, std::move(done) };
+
+    if (timeout < 0) timeout = timeout_;
+    if (timeout > 0) deadlines.setTTL(id, timeout);
+
+    // A connection that goes away from under us or that never existed will
+    // fail the call, possibly before send returns.
+    endpoint.send(fd, std::move(data));
+    return id;
+}
+
+void
+Rpc::
+onPayload(int fd, Payload&& data)
+{
+    auto it = data.cbegin(), last = data.cend();
+
+    Msg::Type type = 0;
+    CallId id = 0;
+    Method method = 0;
+
+    // Whatever is on the other end can't be trusted to speak our protocol.
+    if (data.size() < packedSizeAll(type, id, method)) {
+        endpoint.disconnect(fd);
+        return;
+    }
+
+    it = unpackAll(it, last, type, id, method);
+
+    switch (type) {
+    case Msg::Request: onRequest(fd, id, method, it, last); break;
+    case Msg::Response: onResponse(fd, id, Status::Ok, it, last); break;
+    case Msg::Error: onResponse(fd, id, Status::UnknownMethod, it, last); break;
+    default: endpoint.disconnect(fd); break;
+    }
+}
+
+/** Ids are handed out in sequence so they're easy to guess. Only the
+    connection that a call was sent on gets to answer it.
+ */
+void
+Rpc::
+onResponse(int fd, CallId id, Status status, ConstPackIt it, ConstPackIt last)
+{
+    auto call = calls.find(id);
+    if (call == calls.end()) return;
+
+    if (call->second.fd != fd) {
+        endpoint.disconnect(fd);
+        return;
+    }
+
+    complete(id, status, it, last);
+}
+
+/** Only our own requests matter here since a dropped response is no different
+    from one lost along with its connection as far as the caller is concerned.
+ */
+void
+Rpc::
+onDroppedPayload(int, Payload&& data)
+{
+    Msg::Type type;
+    CallId id;
+    Method method;
+    unpackAll(data.cbegin(), data.cend(), type, id, method);
+
+    if (type == Msg::Request) complete(id, Status::Disconnected);
+}
+
+void
+Rpc::
+onRequest(int fd, CallId id, Method method, ConstPackIt it, ConstPackIt last)
+{
+    auto handler = handlers.find(method);
+
+    if (handler == handlers.end())
+        endpoint.send(fd, packAll(Msg::Error, id, method));
+    else endpoint.send(fd, handler->second(fd, id, it, last));
+}
+
+void
+Rpc::
+complete(CallId id, Status status, ConstPackIt it, ConstPackIt last)
+{
+    auto call = calls.find(id);
+    if (call == calls.end()) return;
+
+    DoneFn done = std::move(call->second.done);
+    calls.erase(call);
+    deadlines.remove(id);
+
+    done(status, it, last);
+}
+
+/** Disconnects are rare enough that a scan of the calls in flight beats
+    keeping a separate index of calls per connection up to date.
+ */
+void
+Rpc::
+onDisconnect(int fd)
+{
+    std::vector<CallId> lost;
+    for (const auto& call : calls)
+        if (call.second.fd == fd) lost.push_back(call.first);
+
+    for (CallId id : lost) complete(id, Status::Disconnected);
+
+    if (onLostConnection) onLostConnection(fd);
+}
+
+} // slick
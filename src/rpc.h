@@ -0,0 +1,152 @@
+/* rpc.h                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Request/response layer on top of Endpoint.
+*/
+
+#pragma once
+
+#include "endpoint.h"
+#include "timeout_queue.h"
+#include "pack.h"
+#include "poll.h"
+
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+namespace slick {
+
+
+/******************************************************************************/
+/* RPC                                                                        */
+/******************************************************************************/
+
+/** Multiplexes any number of calls over the persistent connections of an
+    endpoint. Every request carries a 64 bit id which its response echoes back
+    so calls can be pipelined on a connection and their responses can come
+    back in any order.
+
+    Handlers are registered by method id and take and return any type that can
+    be packed. They're invoked synchronously and the response is sent as soon
+    as they return. Calls to a method without a handler fail with
+    UnknownMethod.
+
+    Every call completes exactly once: with its response, when its deadline
+    passes, or when its connection is lost or was never there to begin with.
+    Responses that show up after that are ignored. Messages with a truncated
+    or unknown header and responses to calls sent on another connection get
+    their connection dropped. Arguments and return values are unpacked as is
+    so both ends must agree on the types of each method.
+
+    Everything must be done from the polling thread.
+ */
+struct Rpc
+{
+    typedef uint16_t Method;
+    typedef uint64_t CallId;
+
+    enum class Status { Ok, UnknownMethod, Timeout, Disconnected };
+
+    explicit Rpc(double timeout = DefaultTimeout);
+    Rpc(Port listenPort, double timeout = DefaultTimeout);
+    ~Rpc();
+
+    Rpc(const Rpc&) = delete;
+    Rpc& operator=(const Rpc&) = delete;
+
+    Endpoint::ConnectionFn onNewConnection;
+    Endpoint::ConnectionFn onLostConnection;
+
+    int fd() const { return poller.fd(); }
+    void poll(size_t timeoutMs = 0) { poller.poll(timeoutMs); }
+
+    int connect(const Address& addr) { return endpoint.connect(addr); }
+    int connect(const NodeAddress& node) { return endpoint.connect(node); }
+    void disconnect(int fd) { endpoint.disconnect(fd); }
+
+    // Deadline in seconds of calls that don't specify one. 0 means never.
+    void timeout(double seconds) { timeout_ = seconds; }
+
+    size_t pending() const { return calls.size(); }
+
+
+    template<typename Ret, typename Arg>
+    void handle(Method method, std::function<Ret(int fd, Arg&& arg)> fn)
+    {
+        handlers[method] = [=] (int fd, CallId id, ConstPackIt it, ConstPackIt last) {
+            Ret ret = fn(fd, unpack<Arg>(it, last));
+            return frame(Msg::Response, id, 0, ret);
+        };
+    }
+
+    /** A negative timeout uses the default deadline. The returned id is
+        unique to this Rpc object and is 0 if the call couldn't be sent.
+     */
+    template<typename Ret, typename Arg>
+    CallId call(
+            int fd, Method method, const Arg& arg,
+            std::function<void(Status status, Ret&& ret)> fn,
+            double timeout = -1)
+    {
+        CallId id = nextId++;
+
+        auto done = [=] (Status status, ConstPackIt it, ConstPackIt last) {
+            if (status == Status::Ok) fn(status, unpack<Ret>(it, last));
+            else fn(status, Ret());
+        };
+
+        return send(fd, id, frame(Msg::Request, id, method, arg), done, timeout);
+    }
+
+private:
+
+    static constexpr double DefaultTimeout = 10;
+
+    struct Msg
+    {
+        typedef uint8_t Type;
+        static constexpr Type Request = 1;
+        static constexpr Type Response = 2;
+        static constexpr Type Error = 3;
+    };
+
+    template<typename T>
+    static Payload frame(Msg::Type type, CallId id, Method method, const T& value)
+    {
+        Payload data(packedSizeAll(type, id, method, value));
+        packAll(data.begin(), data.end(), type, id, method, value);
+        return data;
+    }
+
+    typedef std::function<void(Status, ConstPackIt, ConstPackIt)> DoneFn;
+    CallId send(int fd, CallId id, Payload&& data, DoneFn done, double timeout);
+
+    void init();
+    void onPayload(int fd, Payload&& data);
+    void onDroppedPayload(int fd, Payload&& data);
+    void onRequest(int fd, CallId id, Method method, ConstPackIt it, ConstPackIt last);
+    void onResponse(int fd, CallId id, Status status, ConstPackIt it, ConstPackIt last);
+    void onDisconnect(int fd);
+    void complete(CallId id, Status status, ConstPackIt it = 0, ConstPackIt last = 0);
+
+    double timeout_;
+    CallId nextId;
+
+    typedef std::function<Payload(int, CallId, ConstPackIt, ConstPackIt)> HandlerFn;
+    std::unordered_map<Method, HandlerFn> handlers;
+
+    struct Call
+    {
+        int fd;
+        DoneFn done;
+    };
+    std::unordered_map<CallId, Call> calls;
+
+    SourcePoller poller;
+    Endpoint endpoint;
+    TimeoutQueue<CallId> deadlines;
+};
+
+} // slick
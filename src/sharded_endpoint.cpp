@@ -0,0 +1,244 @@
+/* sharded_endpoint.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Sharded endpoint implementation.
+*/
+
+#include "sharded_endpoint.h"
+
+#include <mutex>
+#include <cassert>
+
+namespace slick {
+
+/******************************************************************************/
+/* SHARDED ENDPOINT                                                           */
+/******************************************************************************/
+
+ShardedEndpoint::
+ShardedEndpoint(size_t shards, Endpoint::Backend backend) :
+    isDone(true), nextShard(0)
+{
+    init(shards, 0, false, backend);
+}
+
+ShardedEndpoint::
+ShardedEndpoint(size_t shards, Port listenPort, Endpoint::Backend backend) :
+    isDone(true), nextShard(0)
+{
+    init(shards, listenPort, true, backend);
+}
+
+ShardedEndpoint::
+~ShardedEndpoint()
+{
+    join();
+}
+
+void
+ShardedEndpoint::
+init(size_t shards, Port listenPort, bool listen, Endpoint::Backend backend)
+{
+    assert(shards > 0);
+    shards_.resize(shards);
+
+    for (size_t i = 0; i < shards; ++i) {
+        auto& endpoint = shards_[i].endpoint;
+
+        // A single shard doesn't need to share its port with anyone.
+        if (listen) endpoint.reset(new Endpoint(listenPort, shards > 1, backend));
+        else endpoint.reset(new Endpoint(backend));
+
+        endpoint->onNewConnection = [=] (int fd) {
+            addRoute(fd, i);
+            if (onNewConnection) onNewConnection(fd);
+        };
+
+        endpoint->onLostConnection = [=] (int fd) {
+            removeRoute(fd, i);
+            if (onLostConnection) onLostConnection(fd);
+        };
+
+        endpoint->onPayloadBatch = [=] (int fd, PayloadSpan batch) {
+            if (onPayloadBatch) {
+                onPayloadBatch(fd, batch);
+                return;
+            }
+
+            for (auto& data : batch) onPayload(fd, std::move(data));
+        };
+
+        endpoint->onDroppedPayload = [=] (int fd, Payload&& data) {
+            if (onDroppedPayload) onDroppedPayload(fd, std::move(data));
+        };
+
+        endpoint->onHighWatermark = [=] (int fd) {
+            if (onHighWatermark) onHighWatermark(fd);
+        };
+
+        endpoint->onLowWatermark = [=] (int fd) {
+            if (onLowWatermark) onLowWatermark(fd);
+        };
+    }
+}
+
+void
+ShardedEndpoint::
+run()
+{
+    assert(isDone);
+    isDone = false;
+
+    std::atomic<size_t> started(0);
+
+    for (auto& shard : shards_) {
+        Endpoint* endpoint = shard.endpoint.get();
+        if (onError) endpoint->onError = onError;
+
+        // Setting it is what turns on chunking so it can't be wrapped.
+        if (onPayloadChunk) endpoint->onPayloadChunk = onPayloadChunk;
+
+        shard.th = std::thread([=, &started] {
+                    endpoint->startPolling();
+                    started++;
+
+                    while (!isDone) endpoint->poll(100);
+                    endpoint->stopPolling();
+                });
+    }
+
+    // Until a shard registers its poll thread, any thread is considered to be
+    // the poll thread which means that operations issued before then would
+    // race with the shard.
+    while (started != shards_.size()) std::this_thread::yield();
+}
+
+void
+ShardedEndpoint::
+join()
+{
+    if (isDone) return;
+    isDone = true;
+
+    for (auto& shard : shards_) shard.th.join();
+}
+
+
+Endpoint*
+ShardedEndpoint::
+route(int fd)
+{
+    std::lock_guard<Lock> guard(routesLock);
+
+    auto it = routes.find(fd);
+    return it != routes.end() ? shards_[it->second].endpoint.get() : nullptr;
+}
+
+void
+ShardedEndpoint::
+addRoute(int fd, size_t shard)
+{
+    std::lock_guard<Lock> guard(routesLock);
+    routes[fd] = shard;
+}
+
+void
+ShardedEndpoint::
+removeRoute(int fd, size_t shard)
+{
+    std::lock_guard<Lock> guard(routesLock);
+
+    // The fd may already have been reused by another shard by the time the
+    // owning shard gets around to notifying us.
+    auto it = routes.find(fd);
+    if (it != routes.end() && it->second == shard) routes.erase(it);
+}
+
+
+int
+ShardedEndpoint::
+connect(const Address& addr)
+{
+    return connect(addrToNode(addr));
+}
+
+int
+ShardedEndpoint::
+connect(const NodeAddress& node)
+{
+    auto socket = Socket::connect(node);
+    if (!socket) return 0;
+
+    size_t shard = nextShard++ % shards_.size();
+
+    // The route must exist before the connection is handed off or we could
+    // miss sends that are issued before the connection is established.
+    int fd = socket.fd();
+    addRoute(fd, shard);
+
+    shards_[shard].endpoint->connect(std::move(socket));
+    return fd;
+}
+
+void
+ShardedEndpoint::
+disconnect(int fd)
+{
+    Endpoint* endpoint = route(fd);
+    if (endpoint) endpoint->disconnect(fd);
+}
+
+
+void
+ShardedEndpoint::
+send(int fd, Payload&& data)
+{
+    Endpoint* endpoint = route(fd);
+
+    if (endpoint) endpoint->send(fd, std::move(data));
+    else if (onDroppedPayload) onDroppedPayload(fd, std::move(data));
+}
+
+void
+ShardedEndpoint::
+multicast(const SortedVector<int>& fds, Payload&& data)
+{
+    if (fds.size() == 1) {
+        send(fds.front(), std::move(data));
+        return;
+    }
+
+    std::vector<int> dropped;
+    std::vector< SortedVector<int> > split(shards_.size());
+    {
+        std::lock_guard<Lock> guard(routesLock);
+
+        for (int fd : fds) {
+            auto it = routes.find(fd);
+            if (it != routes.end()) split[it->second].insert(fd);
+            else dropped.push_back(fd);
+        }
+    }
+
+    if (onDroppedPayload) {
+        for (int fd : dropped) onDroppedPayload(fd, Payload(data));
+    }
+
+    for (size_t i = 0; i < split.size(); ++i) {
+        if (split[i].empty()) continue;
+        shards_[i].endpoint->multicast(split[i], data);
+    }
+}
+
+void
+ShardedEndpoint::
+broadcast(Payload&& data)
+{
+    for (size_t i = 0; i + 1 < shards_.size(); ++i)
+        shards_[i].endpoint->broadcast(data);
+
+    shards_.back().endpoint->broadcast(std::move(data));
+}
+
+} // slick
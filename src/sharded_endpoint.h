@@ -0,0 +1,116 @@
+/* sharded_endpoint.h                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Multi-reactor endpoint which shards connections across poll threads.
+*/
+
+#pragma once
+
+#include "endpoint.h"
+#include "lockless/lock.h"
+
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+namespace slick {
+
+/******************************************************************************/
+/* SHARDED ENDPOINT                                                           */
+/******************************************************************************/
+
+/** Spreads the work of a single listen port over multiple reactors. Each shard
+    is a full Endpoint with its own epoll, its own connection table and its own
+    poll thread. When listening, every shard opens its own set of passive
+    sockets with SO_REUSEPORT which leaves it to the kernel to balance incoming
+    connections across the shards.
+
+    Operations on a connection are routed to the shard that owns its fd. Note
+    that the callbacks are invoked from the poll thread of the shard that owns
+    the connection so they must be thread-safe if more then one shard is used.
+ */
+struct ShardedEndpoint
+{
+    explicit ShardedEndpoint(
+            size_t shards, Endpoint::Backend backend = Endpoint::Backend::Epoll);
+    ShardedEndpoint(
+            size_t shards, Port listenPort,
+            Endpoint::Backend backend = Endpoint::Backend::Epoll);
+    ~ShardedEndpoint();
+
+    ShardedEndpoint(const ShardedEndpoint&) = delete;
+    ShardedEndpoint& operator=(const ShardedEndpoint&) = delete;
+
+    Endpoint::ConnectionFn onNewConnection;
+    Endpoint::ConnectionFn onLostConnection;
+
+    Endpoint::PayloadFn onPayload;
+    Endpoint::PayloadFn onDroppedPayload;
+    Endpoint::PayloadBatchFn onPayloadBatch;
+
+    // Like onError, only handed to the shards on run if set.
+    Endpoint::PayloadChunkFn onPayloadChunk;
+    Endpoint::ErrorFn onError;
+
+    // An fd of -1 refers to the endpoint of one of the shards.
+    Endpoint::ConnectionFn onHighWatermark;
+    Endpoint::ConnectionFn onLowWatermark;
+
+
+    void run();
+    void join();
+
+    size_t shards() const { return shards_.size(); }
+    Endpoint& shard(size_t i) { return *shards_[i].endpoint; }
+
+    void send(int fd, Payload&& data);
+    void send(int fd, const Payload& data)
+    {
+        send(fd, Payload(data));
+    }
+
+    void multicast(const SortedVector<int>& fds, Payload&& data);
+    void multicast(const SortedVector<int>& fds, const Payload& data)
+    {
+        multicast(fds, Payload(data));
+    }
+
+    void broadcast(Payload&& data);
+    void broadcast(const Payload& data)
+    {
+        broadcast(Payload(data));
+    }
+
+    int connect(const Address& addr);
+    int connect(const NodeAddress& node);
+
+    void disconnect(int fd);
+
+private:
+
+    void init(size_t shards, Port listenPort, bool listen,
+            Endpoint::Backend backend);
+
+    Endpoint* route(int fd);
+    void addRoute(int fd, size_t shard);
+    void removeRoute(int fd, size_t shard);
+
+    struct Shard
+    {
+        std::unique_ptr<Endpoint> endpoint;
+        std::thread th;
+    };
+    std::vector<Shard> shards_;
+
+    std::atomic<bool> isDone;
+    std::atomic<size_t> nextShard;
+
+    typedef lockless::UnfairLock Lock;
+    Lock routesLock;
+    std::unordered_map<int, size_t> routes;
+};
+
+} // slick
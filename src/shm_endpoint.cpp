@@ -0,0 +1,727 @@
+/* shm_endpoint.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   ShmEndpoint implementation
+*/
+
+#include "shm_endpoint.h"
+#include "utils.h"
+
+#include <atomic>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+namespace slick {
+
+
+/******************************************************************************/
+/* RING                                                                       */
+/******************************************************************************/
+
+/** Lives in the shared mapping. Positions are free running byte counts which
+    are masked by the capacity when indexing the data that follows the header.
+    Each position and the flags sit on their own cache line so that the two
+    sides don't bounce lines they don't write.
+
+    Everything in here can be scribbled over by the other side at any time so
+    the capacity used to index the data is our own copy taken at handshake.
+ */
+struct ShmEndpoint::Ring
+{
+    alignas(64) std::atomic<uint64_t> head; // written by the reader
+    alignas(64) std::atomic<uint64_t> tail; // written by the writer
+
+    // Set by the reader before waiting on data and by the writer before
+    // waiting on space. Cleared by whoever writes the eventfd.
+    alignas(64) std::atomic<uint32_t> readerIdle;
+    std::atomic<uint32_t> writerBlocked;
+    uint64_t capacity;
+
+    void init(size_t size)
+    {
+        head.store(0);
+        tail.store(0);
+        readerIdle.store(1);
+        writerBlocked.store(0);
+        capacity = size;
+    }
+
+    uint8_t* data() { return reinterpret_cast<uint8_t*>(this + 1); }
+
+    void copyIn(size_t capacity, uint64_t pos, const uint8_t* src, size_t size)
+    {
+        assert(size <= capacity);
+        size_t index = pos & (capacity - 1);
+        size_t n = std::min<size_t>(size, capacity - index);
+
+        std::memcpy(data() + index, src, n);
+        std::memcpy(data(), src + n, size - n);
+    }
+
+    void copyOut(size_t capacity, uint64_t pos, uint8_t* dst, size_t size)
+    {
+        assert(size <= capacity);
+        size_t index = pos & (capacity - 1);
+        size_t n = std::min<size_t>(size, capacity - index);
+
+        std::memcpy(dst, data() + index, n);
+        std::memcpy(dst + n, data(), size - n);
+    }
+};
+
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+namespace {
+
+socklen_t sockAddr(const std::string& name, struct sockaddr_un& addr)
+{
+    static const std::string prefix = "slick.shm.";
+
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+
+    // Leading null byte puts the name in the abstract namespace.
+    size_t size = std::min(prefix.size() + name.size(), sizeof addr.sun_path - 1);
+    std::string path = (prefix + name).substr(0, size);
+    std::memcpy(addr.sun_path + 1, path.data(), size);
+
+    return offsetof(struct sockaddr_un, sun_path) + 1 + size;
+}
+
+void sendFds(int sock, const int* fds, size_t n)
+{
+    char byte = 0;
+    struct iovec iov = { &byte, sizeof byte };
+
+    char control[CMSG_SPACE(sizeof(int) * 2)];
+    std::memset(control, 0, sizeof control);
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n);
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n);
+
+    ssize_t ret;
+    do { ret = sendmsg(sock, &msg, MSG_NOSIGNAL); }
+    while (ret < 0 && errno == EINTR);
+    SLICK_CHECK_ERRNO(ret == 1, "ShmEndpoint.sendmsg");
+}
+
+/** Returns the number of fds received, 0 if the socket has nothing to read
+    and -1 if it was closed.
+ */
+ssize_t recvFds(int sock, int* fds, size_t n)
+{
+    char byte;
+    struct iovec iov = { &byte, sizeof byte };
+
+    char control[CMSG_SPACE(sizeof(int) * 2)];
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    ssize_t ret;
+    do { ret = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC); }
+    while (ret < 0 && errno == EINTR);
+
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    if (ret <= 0) return -1;
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS) return -1;
+
+    size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * std::min(received, n));
+
+    // Anything extra would leak.
+    for (size_t i = n; i < received; ++i)
+        close(reinterpret_cast<int*>(CMSG_DATA(cmsg))[i]);
+
+    return std::min(received, n);
+}
+
+void signalFd(int fd)
+{
+    int ret = eventfd_write(fd, 1);
+    SLICK_CHECK_ERRNO(!ret, "ShmEndpoint.eventfd_write");
+}
+
+} // namespace anonymous
+
+
+/******************************************************************************/
+/* SHM ENDPOINT                                                               */
+/******************************************************************************/
+
+size_t
+ShmEndpoint::
+mappedSize(size_t ringSize)
+{
+    return 2 * (sizeof(Ring) + ringSize);
+}
+
+ShmEndpoint::
+ShmEndpoint(size_t ringSize) :
+    ringSize(ringSize), listenFd(-1),
+    sends(wakeup, WakeSends),
+    disconnects(wakeup, WakeDisconnects)
+{
+    // Masking positions requires a power of two.
+    assert(ringSize && !(ringSize & (ringSize - 1)));
+    assert(ringSize <= MaxRingSize);
+
+    poller.add(wakeup.fd(), EPOLLIN);
+
+    typedef void (ShmEndpoint::*SendFn) (int, Payload&&);
+    sends.onOperation = std::bind((SendFn)&ShmEndpoint::send, this,
+            std::placeholders::_1, std::placeholders::_2);
+
+    disconnects.onOperation = std::bind(&ShmEndpoint::doDisconnect, this,
+            std::placeholders::_1);
+}
+
+ShmEndpoint::
+ShmEndpoint(const std::string& name, size_t ringSize) :
+    ShmEndpoint(ringSize)
+{
+    listen(name);
+}
+
+ShmEndpoint::
+~ShmEndpoint()
+{
+    std::vector<int> toDisconnect;
+    for (const auto& conn : connections) toDisconnect.push_back(conn.first);
+
+    for (int fd : toDisconnect) doDisconnect(fd);
+
+    if (listenFd >= 0) close(listenFd);
+}
+
+void
+ShmEndpoint::
+stopPolling()
+{
+    ThreadAwarePollable::stopPolling();
+
+    // Producers may have pushed without having raised their bit yet.
+    wakeup.poll();
+    pollDeferred(~uint64_t(0), 0);
+}
+
+void
+ShmEndpoint::
+pollDeferred(uint64_t ready, size_t cap)
+{
+    if (ready & WakeSends)       sends.poll(cap);
+    if (ready & WakeDisconnects) disconnects.poll(cap);
+}
+
+void
+ShmEndpoint::
+poll(int timeoutMs)
+{
+    while (poller.poll(timeoutMs)) {
+        struct epoll_event ev = poller.next();
+        int fd = ev.data.fd;
+
+        if (fd == listenFd) accept();
+        else if (fd == wakeup.fd()) pollDeferred(wakeup.poll(), DeferCap);
+        else {
+            auto it = wakeFds.find(fd);
+            if (it != wakeFds.end()) onWake(it->second);
+            else onSocket(fd, ev.events);
+        }
+    }
+}
+
+auto
+ShmEndpoint::
+connection(int fd) -> ConnectionState*
+{
+    auto it = connections.find(fd);
+    return it != connections.end() ? &it->second : nullptr;
+}
+
+void
+ShmEndpoint::
+listen(const std::string& name)
+{
+    assert(listenFd < 0);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    SLICK_CHECK_ERRNO(fd >= 0, "ShmEndpoint.socket");
+    FdGuard guard(fd);
+
+    struct sockaddr_un addr;
+    socklen_t len = sockAddr(name, addr);
+
+    int ret = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), len);
+    SLICK_CHECK_ERRNO(!ret, "ShmEndpoint.bind");
+
+    ret = ::listen(fd, 1U << 8);
+    SLICK_CHECK_ERRNO(!ret, "ShmEndpoint.listen");
+
+    listenFd = guard.release();
+    poller.add(listenFd, EPOLLIN);
+}
+
+void
+ShmEndpoint::
+accept()
+{
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            SLICK_CHECK_ERRNO(fd >= 0, "ShmEndpoint.accept");
+        }
+
+        // Everything else comes with the handshake.
+        connections[fd].fd = fd;
+        poller.add(fd, EPOLLIN | EPOLLRDHUP);
+    }
+}
+
+int
+ShmEndpoint::
+connect(const std::string& name)
+{
+    assert(isPollThread());
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    SLICK_CHECK_ERRNO(fd >= 0, "ShmEndpoint.socket");
+    FdGuard guard(fd);
+
+    struct sockaddr_un addr;
+    socklen_t len = sockAddr(name, addr);
+
+    int ret;
+    do { ret = ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), len); }
+    while (ret < 0 && errno == EINTR);
+    if (ret < 0) return 0;
+
+    int memFd = memfd_create("slick.shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    SLICK_CHECK_ERRNO(memFd >= 0, "ShmEndpoint.memfd_create");
+    FdGuard memGuard(memFd);
+
+    size_t size = mappedSize(ringSize);
+    ret = ftruncate(memFd, size);
+    SLICK_CHECK_ERRNO(!ret, "ShmEndpoint.ftruncate");
+
+    // The other side refuses mappings that could be pulled from under it.
+    ret = fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+    SLICK_CHECK_ERRNO(!ret, "ShmEndpoint.fcntl");
+
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    SLICK_CHECK_ERRNO(map != MAP_FAILED, "ShmEndpoint.mmap");
+
+    int wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    SLICK_CHECK_ERRNO(wakeFd >= 0, "ShmEndpoint.eventfd");
+
+    auto& conn = connections[fd];
+    conn.fd = fd;
+    conn.wakeFd = wakeFd;
+    conn.map = map;
+    conn.mapSize = size;
+    conn.capacity = ringSize;
+
+    // We write the first ring and the other side writes the second.
+    uint8_t* start = static_cast<uint8_t*>(map);
+    conn.out = reinterpret_cast<Ring*>(start);
+    conn.in = reinterpret_cast<Ring*>(start + size / 2);
+    conn.out->init(ringSize);
+    conn.in->init(ringSize);
+
+    int fds[] = { memFd, wakeFd };
+    sendFds(fd, fds, 2);
+
+    wakeFds[wakeFd] = fd;
+    poller.add(wakeFd, EPOLLIN);
+    poller.add(fd, EPOLLIN | EPOLLRDHUP);
+
+    return guard.release();
+}
+
+/** The side that accepted gets the memfd and the eventfd of the other side and
+    answers with its own eventfd. The side that connected only waits on that
+    eventfd.
+ */
+void
+ShmEndpoint::
+handshake(ConnectionState& conn)
+{
+    int fd = conn.fd;
+
+    if (conn.map) {
+        int peerWakeFd;
+        ssize_t n = recvFds(fd, &peerWakeFd, 1);
+        if (!n) return;
+        if (n < 0) { doDisconnect(fd); return; }
+
+        conn.peerWakeFd = peerWakeFd;
+        established(conn);
+        return;
+    }
+
+    int fds[2];
+    ssize_t n = recvFds(fd, fds, 2);
+    if (!n) return;
+    if (n != 2) {
+        if (n > 0) close(fds[0]);
+        doDisconnect(fd);
+        return;
+    }
+
+    FdGuard memGuard(fds[0]);
+    conn.peerWakeFd = fds[1];
+
+    // The other side is not to be trusted with our address space: a memfd
+    // that can be truncated after we map it turns our next access into a
+    // SIGBUS.
+    const int seals = F_SEAL_SHRINK | F_SEAL_GROW;
+    int sealed = fcntl(fds[0], F_GET_SEALS);
+    if (sealed < 0 || (sealed & seals) != seals) {
+        doDisconnect(fd);
+        return;
+    }
+
+    struct stat st;
+    int ret = fstat(fds[0], &st);
+    SLICK_CHECK_ERRNO(!ret, "ShmEndpoint.fstat");
+
+    // The capacity is derived from the size of the mapping rather than from
+    // the header which could make mappedSize overflow.
+    size_t size = st.st_size;
+    size_t capacity = size > mappedSize(0) ? (size - mappedSize(0)) / 2 : 0;
+    if (!capacity || (capacity & (capacity - 1)) || capacity > MaxRingSize
+            || mappedSize(capacity) != size)
+    {
+        doDisconnect(fd);
+        return;
+    }
+
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    if (map == MAP_FAILED) {
+        doDisconnect(fd);
+        return;
+    }
+
+    conn.map = map;
+    conn.mapSize = size;
+
+    uint8_t* start = static_cast<uint8_t*>(map);
+    conn.in = reinterpret_cast<Ring*>(start);
+    conn.out = reinterpret_cast<Ring*>(start + size / 2);
+
+    if (conn.in->capacity != capacity) {
+        doDisconnect(fd);
+        return;
+    }
+    conn.capacity = capacity;
+
+    conn.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    SLICK_CHECK_ERRNO(conn.wakeFd >= 0, "ShmEndpoint.eventfd");
+
+    wakeFds[conn.wakeFd] = fd;
+    poller.add(conn.wakeFd, EPOLLIN);
+
+    sendFds(fd, &conn.wakeFd, 1);
+    established(conn);
+}
+
+void
+ShmEndpoint::
+established(ConnectionState& conn)
+{
+    int fd = conn.fd;
+    conn.connected = true;
+
+    if (onNewConnection) onNewConnection(fd);
+
+    // The callback may have disconnected us and the other side may have
+    // written before we were done.
+    if (!connection(fd)) return;
+    flushQueue(conn);
+    recvPayloads(fd);
+}
+
+void
+ShmEndpoint::
+onSocket(int fd, uint32_t events)
+{
+    auto conn = connection(fd);
+    if (!conn) return;
+
+    if (!conn->connected) {
+        if (events & EPOLLIN) handshake(*conn);
+        else doDisconnect(fd);
+        return;
+    }
+
+    // Nothing is written to the socket once established so this can only be
+    // the other side going away.
+    doDisconnect(fd);
+}
+
+void
+ShmEndpoint::
+onWake(int fd)
+{
+    auto conn = connection(fd);
+    if (!conn) return;
+
+    eventfd_t val;
+    eventfd_read(conn->wakeFd, &val);
+
+    flushQueue(*conn);
+    recvPayloads(fd);
+}
+
+bool
+ShmEndpoint::
+write(ConnectionState& conn, const Payload& data)
+{
+    Ring& ring = *conn.out;
+    size_t size = data.packetSize();
+
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+
+    // A head that makes no sense only stalls the connection of the side that
+    // wrote it.
+    uint64_t used = tail - head;
+    if (used > conn.capacity || conn.capacity - used < size) return false;
+
+    ring.copyIn(conn.capacity, tail, data.packet(), size);
+    ring.tail.store(tail + size, std::memory_order_release);
+    return true;
+}
+
+void
+ShmEndpoint::
+notifyReader(ConnectionState& conn)
+{
+    Ring& ring = *conn.out;
+
+    // Pairs with the fence of the reader between flagging itself as idle and
+    // checking the tail one last time.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (ring.readerIdle.load(std::memory_order_relaxed) &&
+            ring.readerIdle.exchange(0))
+        signalFd(conn.peerWakeFd);
+}
+
+void
+ShmEndpoint::
+flushQueue(ConnectionState& conn)
+{
+    if (!conn.connected) return;
+
+    auto& queue = conn.sendQueue;
+    if (queue.empty()) return;
+
+    Ring& ring = *conn.out;
+
+    while (!queue.empty()) {
+        if (write(conn, queue.front())) {
+            queue.pop_front();
+            continue;
+        }
+
+        // The reader might have freed up space before seeing the flag.
+        ring.writerBlocked.store(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!write(conn, queue.front())) break;
+
+        ring.writerBlocked.store(0);
+        queue.pop_front();
+    }
+
+    notifyReader(conn);
+}
+
+void
+ShmEndpoint::
+send(int fd, Payload&& data)
+{
+    if (!isPollThread()) {
+        sends.defer(fd, std::move(data));
+        return;
+    }
+
+    auto conn = connection(fd);
+    if (!conn) {
+        dropPayload(fd, std::move(data));
+        return;
+    }
+
+    size_t capacity = conn->capacity ? conn->capacity : ringSize;
+    if (data.packetSize() > capacity) {
+        dropPayload(fd, std::move(data));
+        return;
+    }
+
+    if (conn->connected && conn->sendQueue.empty() && write(*conn, data)) {
+        notifyReader(*conn);
+        return;
+    }
+
+    conn->sendQueue.emplace_back(std::move(data));
+    flushQueue(*conn);
+}
+
+bool
+ShmEndpoint::
+readRing(ConnectionState& conn, std::vector<Payload>& queue)
+{
+    Ring& ring = *conn.in;
+    typedef Payload::SizeT SizeT;
+
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    uint64_t tail = ring.tail.load(std::memory_order_acquire);
+
+    if (head == tail) {
+        ring.readerIdle.store(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring.tail.load(std::memory_order_acquire) == head) return false;
+
+        // Might earn us a spurious wakeup if the writer saw the flag.
+        ring.readerIdle.store(0);
+        return true;
+    }
+
+    // Nothing read from the ring is taken at face value and anything that
+    // doesn't add up gets the connection dropped.
+    size_t capacity = conn.capacity;
+    if (tail - head > capacity) {
+        doDisconnect(conn.fd);
+        return false;
+    }
+
+    while (head != tail) {
+        uint64_t available = tail - head;
+
+        SizeT size;
+        if (available < sizeof size) break;
+        ring.copyOut(capacity, head, reinterpret_cast<uint8_t*>(&size), sizeof size);
+        if (size > capacity || sizeof size + uint64_t(size) > available) break;
+
+        Payload data(size);
+        ring.copyOut(capacity, head + sizeof size, data.begin(), size);
+        head += sizeof size + size;
+
+        queue.emplace_back(std::move(data));
+    }
+
+    if (head != tail) {
+        queue.clear();
+        doDisconnect(conn.fd);
+        return false;
+    }
+
+    ring.head.store(head, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring.writerBlocked.load(std::memory_order_relaxed) &&
+            ring.writerBlocked.exchange(0))
+        signalFd(conn.peerWakeFd);
+
+    return true;
+}
+
+void
+ShmEndpoint::
+recvPayloads(int fd)
+{
+    while (true) {
+        auto conn = connection(fd);
+        if (!conn || !conn->connected) return;
+
+        if (!readRing(*conn, recvQueue)) return;
+
+        // Callbacks may disconnect or send which is why the queue is swapped
+        // out and the connection looked up again.
+        std::vector<Payload> queue;
+        std::swap(queue, recvQueue);
+
+        for (auto& data : queue) {
+            if (!connection(fd)) break;
+            onPayload(fd, std::move(data));
+        }
+
+        queue.clear();
+        std::swap(queue, recvQueue);
+    }
+}
+
+void
+ShmEndpoint::
+dropPayload(int fd, Payload&& data) const
+{
+    if (onDroppedPayload) onDroppedPayload(fd, std::move(data));
+}
+
+void
+ShmEndpoint::
+disconnect(int fd)
+{
+    if (!isPollThread()) disconnects.defer(fd);
+    else doDisconnect(fd);
+}
+
+void
+ShmEndpoint::
+doDisconnect(int fd)
+{
+    auto it = connections.find(fd);
+    if (it == connections.end()) return;
+
+    ConnectionState conn = std::move(it->second);
+    connections.erase(it);
+
+    poller.del(conn.fd);
+    close(conn.fd);
+
+    if (conn.wakeFd >= 0) {
+        wakeFds.erase(conn.wakeFd);
+        poller.del(conn.wakeFd);
+        close(conn.wakeFd);
+    }
+
+    if (conn.peerWakeFd >= 0) close(conn.peerWakeFd);
+    if (conn.map) munmap(conn.map, conn.mapSize);
+
+    for (auto& data : conn.sendQueue) dropPayload(fd, std::move(data));
+
+    if (conn.connected && onLostConnection) onLostConnection(fd);
+}
+
+} // slick
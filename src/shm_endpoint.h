@@ -0,0 +1,156 @@
+/* shm_endpoint.h                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Shared memory endpoint for processes on the same host.
+*/
+
+#pragma once
+
+#include "endpoint.h"
+#include "payload.h"
+#include "notify.h"
+#include "defer.h"
+#include "poll.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace slick {
+
+
+/******************************************************************************/
+/* SHM ENDPOINT                                                               */
+/******************************************************************************/
+
+/** Endpoint for processes on the same host which skips the kernel's network
+    stack altogether. Each connection is a pair of single-producer
+    single-consumer rings, one for each direction, in a memfd that both
+    processes map. Frames in the rings have the same layout as on the wire.
+
+    Endpoints are addressed by names in the abstract unix socket namespace. The
+    unix socket of a connection is only used to hand over the memfd and the
+    eventfds of each side but it's kept open to detect the other side going
+    away and its fd is what identifies the connection.
+
+    A side only writes the eventfd of the other when it has flagged itself as
+    idle after finding its ring empty or as blocked after finding the other
+    ring full. A busy connection therefore exchanges payloads without any
+    syscalls.
+
+    Payloads sent before the connection is established or while the ring is
+    full are queued. Payloads that can never fit in the ring are dropped.
+ */
+struct ShmEndpoint : public ThreadAwarePollable
+{
+    enum {
+        DefaultRingSize = 1U << 20,
+        MaxRingSize = 1U << 30, // Larger mappings from a peer are rejected.
+    };
+
+    // The ring size of a connection is picked by the side that connects.
+    explicit ShmEndpoint(size_t ringSize = DefaultRingSize);
+    ShmEndpoint(const std::string& name, size_t ringSize = DefaultRingSize);
+    virtual ~ShmEndpoint();
+
+    ShmEndpoint(const ShmEndpoint&) = delete;
+    ShmEndpoint& operator=(const ShmEndpoint&) = delete;
+
+    Endpoint::ConnectionFn onNewConnection;
+    Endpoint::ConnectionFn onLostConnection;
+
+    Endpoint::PayloadFn onPayload;
+    Endpoint::PayloadFn onDroppedPayload;
+
+    int fd() const { return poller.fd(); }
+    void poll(int timeoutMs = 0);
+    void stopPolling();
+
+    void listen(const std::string& name);
+
+    // Must be called from the poll thread. Returns 0 if the name isn't
+    // listened on.
+    int connect(const std::string& name);
+
+    void send(int fd, Payload&& data);
+    void send(int fd, const Payload& data)
+    {
+        send(fd, Payload(data));
+    }
+
+    void disconnect(int fd);
+
+private:
+
+    struct Ring;
+    static size_t mappedSize(size_t ringSize);
+
+    struct ConnectionState
+    {
+        ConnectionState() :
+            fd(-1), wakeFd(-1), peerWakeFd(-1),
+            map(nullptr), mapSize(0), capacity(0), in(nullptr), out(nullptr),
+            connected(false)
+        {}
+
+        int fd;
+        int wakeFd;
+        int peerWakeFd;
+
+        void* map;
+        size_t mapSize;
+        size_t capacity;  // Of both rings; never read back from the mapping.
+        Ring* in;
+        Ring* out;
+
+        bool connected;
+        std::deque<Payload> sendQueue;
+    };
+
+    ConnectionState* connection(int fd);
+
+    void accept();
+    void handshake(ConnectionState& conn);
+    void established(ConnectionState& conn);
+    void onSocket(int fd, uint32_t events);
+    void onWake(int fd);
+
+    bool write(ConnectionState& conn, const Payload& data);
+    void flushQueue(ConnectionState& conn);
+    void notifyReader(ConnectionState& conn);
+    bool readRing(ConnectionState& conn, std::vector<Payload>& queue);
+    void recvPayloads(int fd);
+
+    void dropPayload(int fd, Payload&& data) const;
+    void doDisconnect(int fd);
+    void pollDeferred(uint64_t ready, size_t cap);
+
+    size_t ringSize;
+
+    Epoll poller;
+    int listenFd;
+
+    std::unordered_map<int, ConnectionState> connections;
+
+    // Maps the eventfd of a connection to its socket.
+    std::unordered_map<int, int> wakeFds;
+
+    // Kept around between reads so that its capacity is reused.
+    std::vector<Payload> recvQueue;
+
+    enum {
+        WakeSends       = 1 << 0,
+        WakeDisconnects = 1 << 1,
+    };
+    Wakeup wakeup;
+
+    enum { SendSize = 1 << 6, DisconnectSize = 1 << 4 };
+    Defer<SendSize, int, Payload> sends;
+    Defer<DisconnectSize, int> disconnects;
+
+    enum { DeferCap = 1 << 6 };
+};
+
+} // slick
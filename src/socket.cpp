@@ -66,6 +66,35 @@ private:
 };
 
 
+/******************************************************************************/
+/* RESOLVE                                                                    */
+/******************************************************************************/
+
+SockAddrs resolve(const Address& addr)
+{
+    assert(addr);
+
+    SockAddrs addrs;
+
+    for (InterfaceIt it(addr.chost(), addr.port); it; it++) {
+        SockAddr sa;
+        std::memset(&sa, 0, sizeof sa);
+
+        sa.family = it->ai_family;
+        sa.socktype = it->ai_socktype;
+        sa.protocol = it->ai_protocol;
+
+        assert(it->ai_addrlen <= sizeof sa.addr);
+        sa.len = it->ai_addrlen;
+        std::memcpy(&sa.addr, it->ai_addr, it->ai_addrlen);
+
+        addrs.push_back(sa);
+    }
+
+    return addrs;
+}
+
+
 /******************************************************************************/
 /* SOCKET                                                                     */
 /******************************************************************************/
@@ -84,6 +113,8 @@ operator=(Socket&& other) noexcept
 {
     if (this == &other) return *this;
 
+    close();
+
     fd_ = other.fd_;
     other.fd_ = -1;
 
@@ -93,20 +124,20 @@ operator=(Socket&& other) noexcept
 
 Socket
 Socket::
-connect(const Address& addr)
+connect(const SockAddrs& addrs)
 {
     Socket socket;
-    assert(addr);
 
-    for (InterfaceIt it(addr.chost(), addr.port); it; it++) {
+    for (const auto& addr : addrs) {
 
         int flags = SOCK_NONBLOCK;
-        int fd = ::socket(it->ai_family, it->ai_socktype | flags, it->ai_protocol);
+        int fd = ::socket(addr.family, addr.socktype | flags, addr.protocol);
         if (fd < 0) continue;
 
         FdGuard guard(fd);
 
-        int ret = ::connect(fd, it->ai_addr, it->ai_addrlen);
+        auto sa = reinterpret_cast<const struct sockaddr*>(&addr.addr);
+        int ret = ::connect(fd, sa, addr.len);
         if (ret < 0 && errno != EINPROGRESS) continue;
 
         socket.fd_ = guard.release();
@@ -117,6 +148,13 @@ connect(const Address& addr)
     return std::move(socket);
 }
 
+Socket
+Socket::
+connect(const Address& addr)
+{
+    return connect(resolve(addr));
+}
+
 Socket
 Socket::
 connect(const NodeAddress& node)
@@ -148,6 +186,18 @@ accept(int fd)
     return std::move(socket);
 }
 
+Socket
+Socket::
+adopt(int fd)
+{
+    assert(fd >= 0);
+
+    Socket socket;
+    socket.fd_ = fd;
+    socket.init();
+    return socket;
+}
+
 void
 Socket::
 init()
@@ -157,14 +207,30 @@ init()
     SLICK_CHECK_ERRNO(!ret, "Socket.setsockopt.TCP_NODELAY");
 }
 
+bool
+Socket::
+busyPoll(unsigned us)
+{
+    int val = us;
+    return !setsockopt(fd_, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof val);
+}
+
 Socket::
 ~Socket()
+{
+    close();
+}
+
+void
+Socket::
+close()
 {
     if (fd_ < 0) return;
 
     // There's no error checking because there's not much we can do if they fail
     shutdown(fd_, SHUT_RDWR);
-    close(fd_);
+    ::close(fd_);
+    fd_ = -1;
 }
 
 int
@@ -194,7 +260,7 @@ throwError() const
 /******************************************************************************/
 
 PassiveSockets::
-PassiveSockets(Port port)
+PassiveSockets(Port port, bool reusePort)
 {
     for (InterfaceIt it(nullptr, port); it; it++) {
 
@@ -204,7 +270,20 @@ PassiveSockets(Port port)
 
         FdGuard guard(fd);
 
-        int ret = bind(fd, it->ai_addr, it->ai_addrlen);
+        // Connections closed on our end linger in TIME_WAIT which would
+        // otherwise keep the port from being reused for a while.
+        int val = true;
+        int ret = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof val);
+        SLICK_CHECK_ERRNO(!ret, "PassiveSockets.setsockopt.SO_REUSEADDR");
+
+        // Allows multiple passive sockets to bind to the same port in which
+        // case the kernel will load balance the incoming connections.
+        if (reusePort) {
+            ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof val);
+            SLICK_CHECK_ERRNO(!ret, "PassiveSockets.setsockopt.SO_REUSEPORT");
+        }
+
+        ret = bind(fd, it->ai_addr, it->ai_addrlen);
         if (ret < 0) continue;
 
         ret = listen(fd, 1U << 8);
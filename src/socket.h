@@ -9,6 +9,7 @@
 
 #include "address.h"
 
+#include <vector>
 #include <algorithm>
 
 namespace slick {
@@ -37,6 +38,29 @@ private:
 };
 
 
+/******************************************************************************/
+/* SOCK ADDR                                                                  */
+/******************************************************************************/
+
+/** Resolved form of an Address which can be connected to without a lookup. */
+struct SockAddr
+{
+    int family;
+    int socktype;
+    int protocol;
+
+    socklen_t len;
+    struct sockaddr_storage addr;
+};
+
+typedef std::vector<SockAddr> SockAddrs;
+
+/** Blocking lookup of every address that a host and port maps to. Throws if
+    the lookup fails.
+ */
+SockAddrs resolve(const Address& addr);
+
+
 /******************************************************************************/
 /* SOCKET                                                                     */
 /******************************************************************************/
@@ -58,12 +82,23 @@ struct Socket
 
     operator bool() const { return fd_ >= 0; }
 
+    /** Sets SO_BUSY_POLL which has reads spin on the device queue for up to
+        the given time when the socket is empty. Best effort since going over
+        the system default requires CAP_NET_ADMIN. Returns whether it took.
+     */
+    bool busyPoll(unsigned us);
+
+    static Socket connect(const SockAddrs& addrs);
     static Socket connect(const Address& addr);
     static Socket connect(const NodeAddress& node);
     static Socket accept(int passiveFd);
 
+    // Takes ownership of an fd that was accepted asynchronously.
+    static Socket adopt(int fd);
+
 private:
     void init();
+    void close();
 
     int fd_;
 };
@@ -76,7 +111,7 @@ private:
 struct PassiveSockets
 {
     PassiveSockets() {}
-    explicit PassiveSockets(Port port);
+    explicit PassiveSockets(Port port, bool reusePort = false);
     ~PassiveSockets();
 
     PassiveSockets(const PassiveSockets&) = delete;
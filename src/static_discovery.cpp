@@ -53,7 +53,7 @@ StaticDiscovery(std::vector<Address> peers, Port port) :
     timer(period_),
     peers(std::move(peers))
 {
-    endpoint.onPayload = bind(&StaticDiscovery::onPayload, this, _1, _2);
+    endpoint.onPayloadBatch = bind(&StaticDiscovery::onPayload, this, _1, _2);
     endpoint.onNewConnection = bind(&StaticDiscovery::onConnect, this, _1);
     endpoint.onLostConnection = bind(&StaticDiscovery::onDisconnect, this, _1);
     poller.add(endpoint);
@@ -115,25 +115,26 @@ shutdown()
 
 void
 StaticDiscovery::
-onPayload(int fd, const Payload& data)
+onPayload(int fd, PayloadSpan batch)
 {
-    auto connIt = connections.find(fd);
-    assert(connIt != connections.end());
-    auto& conn = connIt->second;
+    for (const auto& data : batch) {
+        auto connIt = connections.find(fd);
+        if (connIt == connections.end()) return;
+        auto& conn = connIt->second;
 
+        auto it = data.cbegin(), last = data.cend();
 
-    auto it = data.cbegin(), last = data.cend();
+        if (!conn.initialized()) it = onInit(conn, it, last);
 
-    if (!conn.initialized()) it = onInit(conn, it, last);
+        while (it != last) {
+            Msg::Type type;
+            it = unpack(type, it, last);
 
-    while (it != last) {
-        Msg::Type type;
-        it = unpack(type, it, last);
-
-        switch(type) {
-        case Msg::Keys:  it = onKeys(conn, it, last); break;
-        case Msg::Query: it = onQuery(conn, it, last); break;
-        default: assert(false);
+            switch(type) {
+            case Msg::Keys:  it = onKeys(conn, it, last); break;
+            case Msg::Query: it = onQuery(conn, it, last); break;
+            default: assert(false);
+            }
         }
     }
 
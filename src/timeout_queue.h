@@ -7,23 +7,59 @@
 
 #pragma once
 
+#include "timer.h"
+#include "utils.h"
+
+#include <array>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <cassert>
+#include <cstdint>
+
 namespace slick {
 
 
 /******************************************************************************/
-/* TIEMOUT QUEUE                                                              */
+/* TIMEOUT QUEUE                                                              */
 /******************************************************************************/
 
-template<typename Key, typename Clock = lockless::Wall>
+/** Hierarchical timing wheel where time is counted in ticks of a fixed
+    resolution.
+
+    Each level has 256 slots and each slot of a level spans all the slots of
+    the level below it. A deadline is filed under the lowest level whose span
+    still reaches it from the current tick and trickles down a level whenever
+    the wheel below wraps around. Deadlines past the span of the top level
+    are filed at its edge and re-filed when they get there.
+
+    Entries are linked into their slot through indexes in a single pool which
+    is recycled so setting, resetting and removing a deadline are all O(1)
+    and don't allocate once the pool has warmed up.
+
+    The timer fd is a periodic tick which is only armed while there are
+    deadlines pending. Ticks where nothing can expire are skipped over.
+
+    Deadlines are on the monotonic clock by default so that TTLs are immune
+    to changes of the system time.
+ */
+template<typename Key, typename Clock = MonotonicClock>
 struct TimeoutQueue
 {
-    typedef Clock::ClockT ClockT;
+    typedef typename Clock::ClockT ClockT;
+
+    explicit TimeoutQueue(double resolution = DefaultResolution);
+
+    TimeoutQueue(const TimeoutQueue&) = delete;
+    TimeoutQueue& operator=(const TimeoutQueue&) = delete;
 
     typedef std::function<void(Key)> TimeoutFn;
     TimeoutFn onTimeout;
 
     int fd() const { return timer.fd(); }
-    void poll(int timeoutMs = 0);
+    void poll();
 
     void set(const Key& key, ClockT deadline);
     void setTTL(const Key& key, ClockT ttl);
@@ -31,60 +67,189 @@ struct TimeoutQueue
 
     ClockT deadline(const Key& key) const;
 
+    size_t size() const { return keys.size(); }
+    bool empty() const { return keys.empty(); }
+
 private:
 
-    void updateTimer(ClockT now = clock())
-    {
-        ClockT next = queue.top().deadline;
-        double delay = Clock::toSec(Clock::diff(now, next));
-        timer.setDelay(delay);
-    }
+    static constexpr double DefaultResolution = 0.01;
 
-    struct Deadline
+    enum {
+        SlotBits = 8,
+        Slots = 1U << SlotBits,
+        Levels = 4,
+    };
+
+    static constexpr uint32_t Nil = std::numeric_limits<uint32_t>::max();
+
+    struct Entry
     {
         Key key;
         ClockT deadline;
+        uint64_t tick;
 
-        explicit Deadline(Key key = Key(), ClockT deadline = 0) :
-            key(std::move(key)), deadline(deadline)
-        {}
-
-        bool operator< (const Deadline& other)
-        {
-            return deadline < other.deadline;
-        }
+        uint32_t slot;
+        uint32_t prev;
+        uint32_t next;
     };
 
+    uint64_t toTick(ClockT time) const
+    {
+        return Clock::toSec(time) / resolution;
+    }
+
+    void link(uint32_t index);
+    void unlink(uint32_t index);
+    void advance(uint64_t tick, std::vector<Key>& triggered);
+
     Clock clock;
     Timer timer;
-    std::priority_queue<Deadline> queue;
-    std::map<Key, ClockT> keys;
+    double resolution;
+
+    uint64_t current;
+    std::array<uint32_t, Levels * Slots> slots;
+    std::array<size_t, Levels> counts;
+
+    std::vector<Entry> entries;
+    uint32_t freeList;
+
+    std::unordered_map<Key, uint32_t> keys;
 };
 
 
+template<typename Key, typename Clock>
+constexpr double TimeoutQueue<Key, Clock>::DefaultResolution;
+
+template<typename Key, typename Clock>
+constexpr uint32_t TimeoutQueue<Key, Clock>::Nil;
+
+
+template<typename Key, typename Clock>
+TimeoutQueue<Key, Clock>::
+TimeoutQueue(double resolution) :
+    resolution(resolution), current(0), freeList(Nil)
+{
+    assert(resolution > 0);
+
+    slots.fill(Nil);
+    counts.fill(0);
+}
+
+
 template<typename Key, typename Clock>
 void
 TimeoutQueue<Key, Clock>::
-poll(int timeoutMs)
+poll()
 {
-    ClockT now = clock();
+    timer.poll();
+    if (keys.empty()) return;
 
+    uint64_t now = toTick(clock());
     std::vector<Key> triggered;
 
-    while (!queue.empty()) {
-        auto& item = queue.top();
+    while (current < now) {
 
-        if (!keys.count(item.key)) continue;
-        if (item.deadline > now) break;
+        // Nothing can expire before the next time a non-empty level has to
+        // trickle down so we can skip straight to it.
+        uint64_t step = 1;
+        for (size_t level = 0; level < Levels - 1 && !counts[level]; ++level)
+            step <<= SlotBits;
 
-        triggered.push_back(std::move(item.key));
-        queue.pop();
+        uint64_t next = (current | (step - 1)) + 1;
+        if (next > now) {
+            current = now;
+            break;
+        }
+
+        advance(next, triggered);
     }
 
-    if (!queue.empty()) updateTimer(now);
+    if (keys.empty()) timer.setDelay(0);
 
     for (Key& key : triggered)
-        timeoutFn(std::move(key));
+        onTimeout(std::move(key));
+}
+
+
+template<typename Key, typename Clock>
+void
+TimeoutQueue<Key, Clock>::
+advance(uint64_t tick, std::vector<Key>& triggered)
+{
+    current = tick;
+
+    // Higher levels first so that their entries can keep on trickling down
+    // through the levels that wrap on the same tick.
+    for (size_t level = Levels - 1; level > 0; --level) {
+        if (tick & ((uint64_t(1) << (SlotBits * level)) - 1)) continue;
+
+        uint32_t& head = slots[level * Slots + ((tick >> (SlotBits * level)) % Slots)];
+        while (head != Nil) {
+            uint32_t index = head;
+            unlink(index);
+            link(index);
+        }
+    }
+
+    uint32_t& head = slots[tick % Slots];
+    while (head != Nil) {
+        uint32_t index = head;
+        Entry& entry = entries[index];
+        unlink(index);
+
+        // Filed at the edge of the wheel and still out of reach.
+        if (entry.tick > tick) {
+            link(index);
+            continue;
+        }
+
+        keys.erase(entry.key);
+        triggered.emplace_back(std::move(entry.key));
+
+        entry.next = freeList;
+        freeList = index;
+    }
+}
+
+
+template<typename Key, typename Clock>
+void
+TimeoutQueue<Key, Clock>::
+link(uint32_t index)
+{
+    Entry& entry = entries[index];
+
+    uint64_t tick = entry.tick;
+    uint64_t span = uint64_t(1) << (SlotBits * Levels);
+    if (tick - current >= span) tick = current + span - 1;
+
+    size_t level = 0;
+    while (level < Levels - 1 && (tick ^ current) >> (SlotBits * (level + 1)))
+        level++;
+
+    entry.slot = level * Slots + ((tick >> (SlotBits * level)) % Slots);
+    entry.prev = Nil;
+    entry.next = slots[entry.slot];
+
+    if (entry.next != Nil) entries[entry.next].prev = index;
+    slots[entry.slot] = index;
+    counts[level]++;
+}
+
+
+template<typename Key, typename Clock>
+void
+TimeoutQueue<Key, Clock>::
+unlink(uint32_t index)
+{
+    Entry& entry = entries[index];
+
+    if (entry.prev != Nil) entries[entry.prev].next = entry.next;
+    else slots[entry.slot] = entry.next;
+
+    if (entry.next != Nil) entries[entry.next].prev = entry.prev;
+
+    counts[entry.slot / Slots]--;
 }
 
 
@@ -102,16 +267,34 @@ void
 TimeoutQueue<Key, Clock>::
 set(const Key& key, ClockT deadline)
 {
-    auto ret = keys.insert(std::make_pair(key, deadline));
+    if (keys.empty()) {
+        current = toTick(clock());
+        timer.setDelay(resolution);
+    }
+
+    auto ret = keys.insert(std::make_pair(key, freeList));
+    uint32_t& index = ret.first->second;
+
     if (!ret.second) {
-        auto& oldDeadline = ret.first->second;
-        if (deadline == oldDeadline) return;
-        oldDeadline = deadline;
+        if (entries[index].deadline == deadline) return;
+        unlink(index);
     }
 
-    bool update = deadline < queue.top().deadline;
-    queue.emplace(key, deadline);
-    if (update) updateTimer();
+    else if (index != Nil) freeList = entries[index].next;
+
+    else {
+        index = entries.size();
+        entries.emplace_back();
+    }
+
+    Entry& entry = entries[index];
+    entry.key = key;
+    entry.deadline = deadline;
+
+    // Deadlines that are already due go off on the next tick.
+    entry.tick = std::max(toTick(deadline), current + 1);
+
+    link(index);
 }
 
 
@@ -120,7 +303,17 @@ void
 TimeoutQueue<Key, Clock>::
 remove(const Key& key)
 {
-    keys.erase(key);
+    auto it = keys.find(key);
+    if (it == keys.end()) return;
+
+    uint32_t index = it->second;
+    unlink(index);
+    keys.erase(it);
+
+    entries[index].next = freeList;
+    freeList = index;
+
+    if (keys.empty()) timer.setDelay(0);
 }
 
 
@@ -131,7 +324,7 @@ deadline(const Key& key) const -> ClockT
 {
     auto it = keys.find(key);
     assert(it != keys.end());
-    return it->second.deadline;
+    return entries[it->second].deadline;
 }
 
 } // slick
@@ -0,0 +1,218 @@
+/* uring.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   io_uring wrapper
+*/
+
+#include "uring.h"
+#include "utils.h"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace slick {
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+namespace {
+
+template<typename T>
+T* offset(void* base, size_t off)
+{
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + off);
+}
+
+void* mapRing(int fd, size_t size, off_t off, const char* msg)
+{
+    void* ptr = mmap(nullptr, size,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, off);
+    SLICK_CHECK_ERRNO(ptr != MAP_FAILED, msg);
+    return ptr;
+}
+
+} // namespace anonymous
+
+
+/******************************************************************************/
+/* IO URING                                                                   */
+/******************************************************************************/
+
+IoUring::
+IoUring(unsigned entries) : sqPending(0)
+{
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof params);
+
+    fd_ = syscall(__NR_io_uring_setup, entries, &params);
+    SLICK_CHECK_ERRNO(fd_ >= 0, "IoUring.io_uring_setup");
+
+    const auto& sq = params.sq_off;
+    const auto& cq = params.cq_off;
+
+    sqRingSize = sq.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = cq.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        sqRing = cqRing = mapRing(
+                fd_, sqRingSize, IORING_OFF_SQ_RING, "IoUring.mmap.ring");
+    }
+    else {
+        sqRing = mapRing(fd_, sqRingSize, IORING_OFF_SQ_RING, "IoUring.mmap.sq");
+        cqRing = mapRing(fd_, cqRingSize, IORING_OFF_CQ_RING, "IoUring.mmap.cq");
+    }
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = static_cast<struct io_uring_sqe*>(
+            mapRing(fd_, sqesSize, IORING_OFF_SQES, "IoUring.mmap.sqes"));
+
+    sqHead = offset<unsigned>(sqRing, sq.head);
+    sqTail = offset<unsigned>(sqRing, sq.tail);
+    sqMask = *offset<unsigned>(sqRing, sq.ring_mask);
+    sqEntries = *offset<unsigned>(sqRing, sq.ring_entries);
+    sqArray = offset<unsigned>(sqRing, sq.array);
+
+    cqHead = offset<unsigned>(cqRing, cq.head);
+    cqTail = offset<unsigned>(cqRing, cq.tail);
+    cqMask = *offset<unsigned>(cqRing, cq.ring_mask);
+    cqes = offset<struct io_uring_cqe>(cqRing, cq.cqes);
+}
+
+IoUring::
+~IoUring()
+{
+    munmap(sqes, sqesSize);
+    if (cqRing != sqRing) munmap(cqRing, cqRingSize);
+    munmap(sqRing, sqRingSize);
+
+    // There's no error checking because there's not much we can do if it fails
+    close(fd_);
+}
+
+unsigned
+IoUring::
+enter(unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    while (true) {
+        int ret = syscall(__NR_io_uring_enter,
+                fd_, toSubmit, minComplete, flags, nullptr, 0);
+
+        if (ret < 0 && errno == EINTR) continue;
+        SLICK_CHECK_ERRNO(ret >= 0, "IoUring.io_uring_enter");
+
+        return ret;
+    }
+}
+
+struct io_uring_sqe*
+IoUring::
+sqe()
+{
+    unsigned tail = *sqTail;
+    if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) == sqEntries)
+        submit();
+
+    // Without SQPOLL the kernel only looks at the queue from within
+    // io_uring_enter so the entry can be filled in after the tail is bumped.
+    unsigned index = tail & sqMask;
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    sqPending++;
+
+    struct io_uring_sqe* entry = &sqes[index];
+    std::memset(entry, 0, sizeof *entry);
+    return entry;
+}
+
+void
+IoUring::
+submit()
+{
+    while (sqPending)
+        sqPending -= enter(sqPending, 0, 0);
+}
+
+void
+IoUring::
+wait()
+{
+    sqPending -= enter(sqPending, 1, IORING_ENTER_GETEVENTS);
+}
+
+bool
+IoUring::
+poll()
+{
+    return __atomic_load_n(cqTail, __ATOMIC_ACQUIRE) != *cqHead;
+}
+
+struct io_uring_cqe
+IoUring::
+next()
+{
+    while (!poll()) wait();
+
+    unsigned head = *cqHead;
+    struct io_uring_cqe cqe = cqes[head & cqMask];
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+
+    return cqe;
+}
+
+
+/******************************************************************************/
+/* URING BUFFERS                                                              */
+/******************************************************************************/
+
+UringBuffers::
+UringBuffers(IoUring& ring, uint16_t group, unsigned count, unsigned size) :
+    ring(ring), group_(group), count(count), size(size)
+{
+    assert(count && count <= 1U << 16);
+
+    data = new uint8_t[size_t(count) * size];
+
+    // Has to reach the kernel before anything can select from the group.
+    provide(0, count);
+    ring.submit();
+}
+
+UringBuffers::
+~UringBuffers()
+{
+    // The kernel forgets about the group along with the ring so there's no
+    // need to remove the buffers as long as nothing is still in flight.
+    delete[] data;
+}
+
+void
+UringBuffers::
+recycle(uint16_t id)
+{
+    assert(id < count);
+    provide(id, 1);
+}
+
+void
+UringBuffers::
+provide(uint16_t id, unsigned n)
+{
+    struct io_uring_sqe* sqe = ring.sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = n;
+    sqe->addr = uint64_t(get(id));
+    sqe->len = size;
+    sqe->off = id;
+    sqe->buf_group = group_;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = 0;
+}
+
+} // slick
@@ -0,0 +1,127 @@
+/* uring.h                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   io_uring wrapper
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+namespace slick {
+
+/******************************************************************************/
+/* IO URING                                                                   */
+/******************************************************************************/
+
+/** Minimal wrapper around the raw io_uring syscalls.
+
+    Submissions are only queued by sqe() and are handed to the kernel in a
+    single batch by submit(). Completions are read straight out of the shared
+    ring which doesn't require a syscall. The ring's fd becomes readable
+    whenever there are completions waiting so it can be nested in an epoll set
+    like any other source.
+ */
+struct IoUring
+{
+    enum { DefaultEntries = 1U << 8 };
+
+    explicit IoUring(unsigned entries = DefaultEntries);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    int fd() const { return fd_; }
+
+    /** Returns a zeroed submission entry. Submits whatever is queued first if
+        the submission queue is full.
+     */
+    struct io_uring_sqe* sqe();
+
+    void submit();
+
+    /** Blocks until at least one completion is available. */
+    void wait();
+
+    bool poll();
+    struct io_uring_cqe next();
+
+private:
+
+    unsigned enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+
+    int fd_;
+
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned* sqArray;
+    unsigned sqPending;
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+};
+
+
+/******************************************************************************/
+/* URING BUFFERS                                                              */
+/******************************************************************************/
+
+/** Pool of fixed size buffers handed to the kernel as a provided buffer group.
+    Operations submitted with IOSQE_BUFFER_SELECT pick their buffer from the
+    group when data is actually available which is what allows a multishot
+    recv to be armed on any number of idle connections without tying up any
+    memory.
+
+    Buffers must be handed back with recycle() once consumed which queues a
+    submission that only completes, with a user data of 0, if it failed.
+ */
+struct UringBuffers
+{
+    enum {
+        DefaultCount = 1U << 8,
+        DefaultSize = 1U << 14,
+    };
+
+    UringBuffers(
+            IoUring& ring,
+            uint16_t group,
+            unsigned count = DefaultCount,
+            unsigned size = DefaultSize);
+    ~UringBuffers();
+
+    UringBuffers(const UringBuffers&) = delete;
+    UringBuffers& operator=(const UringBuffers&) = delete;
+
+    uint16_t group() const { return group_; }
+
+    uint8_t* get(uint16_t id) const { return data + size_t(id) * size; }
+    void recycle(uint16_t id);
+
+private:
+
+    void provide(uint16_t id, unsigned n);
+
+    IoUring& ring;
+    uint16_t group_;
+
+    unsigned count;
+    unsigned size;
+    uint8_t* data;
+};
+
+} // slick
@@ -13,6 +13,7 @@
 #include <stdexcept>
 #include <cstdlib>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 namespace slick {
@@ -47,6 +48,35 @@ inline std::string checkErrnoString(const std::string& msg)
 
 
 
+/******************************************************************************/
+/* MONOTONIC TIME                                                             */
+/******************************************************************************/
+
+/** Seconds since some arbitrary point in the past which is only good for
+    measuring intervals. Cheap enough to take on every poll since
+    clock_gettime goes through the vDSO.
+
+    Use this over lockless::wall() and lockless::monotonic() which scale
+    nanoseconds by 1e-10: they run 10x slow within each second and then jump
+    forward at the second boundary.
+ */
+inline double monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Clock of monotonicTime() for TimeoutQueue.
+struct MonotonicClock
+{
+    typedef double ClockT;
+
+    ClockT operator() () const { return monotonicTime(); }
+    static constexpr double toSec(ClockT t) { return t; }
+};
+
+
 /******************************************************************************/
 /* SEQ                                                                        */
 /******************************************************************************/
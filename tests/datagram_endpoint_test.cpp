@@ -0,0 +1,125 @@
+/* datagram_endpoint_test.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Tests for the datagram endpoint.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "datagram_endpoint.h"
+#include "pack.h"
+#include "lockless/format.h"
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <set>
+
+using namespace std;
+using namespace slick;
+using namespace lockless;
+
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+SockAddr localhost(Port port)
+{
+    return resolve(Address("127.0.0.1", port)).front();
+}
+
+void exchange(bool gso)
+{
+    // Datagrams can be lost so the bursts are kept well below what the socket
+    // buffers can hold.
+    enum { Payloads = 256, Burst = 32 };
+
+    DatagramEndpoint server;
+    server.gso(gso);
+
+    DatagramEndpoint client;
+    client.gso(gso);
+
+    size_t dropped = 0;
+    client.onDroppedPayload = [&] (const SockAddr&, Payload&&) { dropped++; };
+    server.onDroppedPayload = [&] (const SockAddr&, Payload&&) { dropped++; };
+
+    // Answers are batched until the end of the server's poll.
+    server.onPayload = [&] (const SockAddr& addr, Payload&& data) {
+        server.send(addr, std::move(data));
+    };
+
+    std::set<uint64_t> echoed;
+    client.onPayload = [&] (const SockAddr&, Payload&& data) {
+        echoed.insert(unpack<uint64_t>(data));
+    };
+
+    SockAddr addr = localhost(server.port());
+
+    for (uint64_t i = 0; i < Payloads; i += Burst) {
+        for (uint64_t j = i; j < i + Burst; ++j)
+            client.send(addr, pack(j));
+
+        for (size_t k = 0; k < 100 && echoed.size() < i + Burst; ++k) {
+            server.poll(1);
+            client.poll(1);
+        }
+    }
+
+    BOOST_CHECK_EQUAL(dropped, 0);
+    BOOST_CHECK_EQUAL(echoed.size(), Payloads);
+}
+
+
+/******************************************************************************/
+/* TESTS                                                                      */
+/******************************************************************************/
+
+BOOST_AUTO_TEST_CASE(basics)
+{
+    cerr << fmtTitle("basics", '=') << endl;
+    exchange(false);
+}
+
+BOOST_AUTO_TEST_CASE(gso)
+{
+    cerr << fmtTitle("gso", '=') << endl;
+    exchange(true);
+}
+
+BOOST_AUTO_TEST_CASE(malformed)
+{
+    cerr << fmtTitle("malformed", '=') << endl;
+
+    enum { MaxDatagram = 1 << 10 };
+
+    DatagramEndpoint server(0, MaxDatagram);
+    DatagramEndpoint client;
+
+    size_t recv = 0, dropped = 0;
+    server.onPayload = [&] (const SockAddr&, Payload&&) { recv++; };
+    client.onDroppedPayload = [&] (const SockAddr&, Payload&&) { dropped++; };
+
+    SockAddr addr = localhost(server.port());
+
+    // Too large for the receiving side which drops it without a word.
+    client.send(addr, Payload(MaxDatagram));
+
+    // A frame whose header doesn't match the size of the datagram.
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    uint8_t bogus[] = { 0xFF, 0, 0, 0, 1, 2 };
+    sendto(fd, bogus, sizeof bogus, 0,
+            reinterpret_cast<const struct sockaddr*>(&addr.addr), addr.len);
+    close(fd);
+
+    // Too large for any datagram.
+    client.send(addr, Payload(DatagramEndpoint::MaxDatagram));
+    BOOST_CHECK_EQUAL(dropped, 1);
+
+    client.send(addr, Payload(1));
+
+    for (size_t i = 0; i < 100 && !recv; ++i) server.poll(1);
+    BOOST_CHECK_EQUAL(recv, 1);
+}
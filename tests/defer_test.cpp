@@ -0,0 +1,130 @@
+/* defer_test.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Tests for the defer queue.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "defer.h"
+#include "payload.h"
+#include "lockless/format.h"
+
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <sys/poll.h>
+
+using namespace std;
+using namespace slick;
+using namespace lockless;
+
+
+/******************************************************************************/
+/* QUEUE                                                                      */
+/******************************************************************************/
+
+BOOST_AUTO_TEST_CASE(queue_full)
+{
+    cerr << fmtTitle("queue_full", '=') << endl;
+
+    enum { Size = 8 };
+    Queue<Payload, Size> queue;
+
+    for (size_t i = 0; i < Size; ++i)
+        BOOST_CHECK(queue.push(Payload(i)));
+
+    // A rejected value must be left intact.
+    Payload extra(10);
+    BOOST_CHECK(!queue.emplace(std::move(extra)));
+    BOOST_CHECK(extra);
+
+    for (size_t lap = 0; lap < 3; ++lap) {
+        BOOST_CHECK_EQUAL(queue.pop().size(), lap);
+        BOOST_CHECK(queue.emplace(Payload(Size + lap)));
+    }
+
+    for (size_t i = 0; i < Size; ++i)
+        BOOST_CHECK_EQUAL(queue.pop().size(), i + 3);
+
+    BOOST_CHECK(queue.empty());
+}
+
+
+/******************************************************************************/
+/* DEFER                                                                      */
+/******************************************************************************/
+
+BOOST_AUTO_TEST_CASE(defer_mpsc)
+{
+    cerr << fmtTitle("defer_mpsc", '=') << endl;
+
+    enum { Producers = 4, Ops = 10000 };
+
+    Defer<1 << 6, size_t, size_t> defer;
+
+    vector<size_t> next(Producers, 0);
+    size_t received = 0;
+    bool ordered = true;
+
+    defer.onOperation = [&] (size_t producer, size_t i) {
+        if (i != next[producer]) ordered = false;
+        next[producer] = i + 1;
+        received++;
+    };
+
+    vector<thread> producers;
+    for (size_t id = 0; id < Producers; ++id) {
+        producers.emplace_back([&, id] {
+            for (size_t i = 0; i < Ops; ++i)
+                while (!defer.tryDefer(id, i)) this_thread::yield();
+        });
+    }
+
+    struct pollfd pfd = { defer.fd(), POLLIN, 0 };
+    while (received != Producers * Ops) {
+        ::poll(&pfd, 1, 10);
+        defer.poll(1 << 6);
+    }
+
+    for (auto& th : producers) th.join();
+
+    BOOST_CHECK(ordered);
+    BOOST_CHECK_EQUAL(received, Producers * Ops);
+}
+
+BOOST_AUTO_TEST_CASE(shared_wakeup)
+{
+    cerr << fmtTitle("shared_wakeup", '=') << endl;
+
+    Wakeup wakeup;
+    Defer<1 << 4, size_t> first(wakeup, 1 << 0);
+    Defer<1 << 4, size_t> second(wakeup, 1 << 1);
+
+    BOOST_CHECK_EQUAL(first.fd(), wakeup.fd());
+    BOOST_CHECK_EQUAL(second.fd(), wakeup.fd());
+
+    size_t sum = 0;
+    first.onOperation = [&] (size_t i) { sum += i; };
+    second.onOperation = [&] (size_t i) { sum += i * 10; };
+
+    BOOST_CHECK_EQUAL(wakeup.poll(), 0);
+
+    for (size_t i = 0; i < 4; ++i) second.defer(1);
+    BOOST_CHECK_EQUAL(wakeup.poll(), 1 << 1);
+
+    second.poll(2);
+    BOOST_CHECK_EQUAL(sum, 20);
+
+    // Hitting the cap raises the bit again for the leftovers.
+    first.defer(1);
+    BOOST_CHECK_EQUAL(wakeup.poll(), (1 << 0) | (1 << 1));
+
+    first.poll();
+    second.poll();
+    BOOST_CHECK_EQUAL(sum, 41);
+    BOOST_CHECK_EQUAL(wakeup.poll(), 0);
+}
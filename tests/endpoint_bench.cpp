@@ -0,0 +1,383 @@
+/* endpoint_bench.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Throughput and latency benchmark of Endpoint over loopback.
+
+   Every run echoes payloads through a provider while the client keeps a fixed
+   number of payloads in flight on every connection. Each payload carries the
+   time at which it was sent which gives us a round trip latency sample for
+   every echo. Payloads are either sent from the client's poll thread as soon
+   as an echo comes back or by a set of sender threads which go through the
+   cross-thread send path.
+
+   Results are written to stdout as a JSON array with one object per run.
+
+   Usage: endpoint_bench [options]
+     --backends LIST     epoll,uring
+     --connections LIST  connections per run (8)
+     --sizes LIST        payload sizes in bytes (32,1024,16384)
+     --depth LIST        payloads in flight per connection (64)
+     --threads LIST      sender threads, 0 sends from the poll thread (0)
+     --warmup MS         (200)
+     --duration MS       (2000)
+     --port PORT         first port to listen on (40000)
+
+   Every combination of the lists is benchmarked.
+*/
+
+#include "endpoint.h"
+#include "lockless/tm.h"
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+
+using namespace std;
+using namespace slick;
+
+
+/******************************************************************************/
+/* CONFIG                                                                     */
+/******************************************************************************/
+
+struct Config
+{
+    vector<Endpoint::Backend> backends;
+    vector<size_t> connections;
+    vector<size_t> sizes;
+    vector<size_t> depths;
+    vector<size_t> threads;
+
+    size_t warmupMs;
+    size_t durationMs;
+    Port port;
+
+    Config() :
+        backends({ Endpoint::Backend::Epoll, Endpoint::Backend::Uring }),
+        connections({ 8 }),
+        sizes({ 32, 1024, 16384 }),
+        depths({ 64 }),
+        threads({ 0 }),
+        warmupMs(200), durationMs(2000), port(40000)
+    {}
+};
+
+const char* backendName(Endpoint::Backend backend)
+{
+    return backend == Endpoint::Backend::Uring ? "uring" : "epoll";
+}
+
+vector<string> split(const char* str)
+{
+    vector<string> result;
+
+    string value;
+    for (const char* it = str; *it; ++it) {
+        if (*it != ',') { value += *it; continue; }
+        result.push_back(value);
+        value.clear();
+    }
+    result.push_back(value);
+
+    return result;
+}
+
+vector<size_t> parseSizes(const char* str)
+{
+    vector<size_t> result;
+    for (const auto& value : split(str))
+        result.push_back(strtoull(value.c_str(), nullptr, 10));
+    return result;
+}
+
+vector<Endpoint::Backend> parseBackends(const char* str)
+{
+    vector<Endpoint::Backend> result;
+
+    for (const auto& value : split(str)) {
+        if (value == "epoll") result.push_back(Endpoint::Backend::Epoll);
+        else if (value == "uring") result.push_back(Endpoint::Backend::Uring);
+        else {
+            fprintf(stderr, "unknown backend: %s\n", value.c_str());
+            exit(1);
+        }
+    }
+
+    return result;
+}
+
+Config parseArgs(int argc, char** argv)
+{
+    Config config;
+
+    enum {
+        OptBackends, OptConnections, OptSizes, OptDepth,
+        OptThreads, OptWarmup, OptDuration, OptPort
+    };
+
+    const struct option options[] = {
+        { "backends",    required_argument, nullptr, OptBackends },
+        { "connections", required_argument, nullptr, OptConnections },
+        { "sizes",       required_argument, nullptr, OptSizes },
+        { "depth",       required_argument, nullptr, OptDepth },
+        { "threads",     required_argument, nullptr, OptThreads },
+        { "warmup",      required_argument, nullptr, OptWarmup },
+        { "duration",    required_argument, nullptr, OptDuration },
+        { "port",        required_argument, nullptr, OptPort },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+        switch (opt) {
+        case OptBackends:    config.backends = parseBackends(optarg); break;
+        case OptConnections: config.connections = parseSizes(optarg); break;
+        case OptSizes:       config.sizes = parseSizes(optarg); break;
+        case OptDepth:       config.depths = parseSizes(optarg); break;
+        case OptThreads:     config.threads = parseSizes(optarg); break;
+        case OptWarmup:      config.warmupMs = atoi(optarg); break;
+        case OptDuration:    config.durationMs = atoi(optarg); break;
+        case OptPort:        config.port = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: see the header of endpoint_bench.cpp\n");
+            exit(1);
+        }
+    }
+
+    return config;
+}
+
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+uint64_t nowNs()
+{
+    auto now = chrono::steady_clock::now().time_since_epoch();
+    return chrono::duration_cast<chrono::nanoseconds>(now).count();
+}
+
+/** The timestamp takes up the head of the payload which bounds the size from
+    below.
+ */
+Payload makePayload(size_t size)
+{
+    Payload data(max(size, sizeof(uint64_t)));
+    uint64_t ts = nowNs();
+    memcpy(data.begin(), &ts, sizeof ts);
+    return data;
+}
+
+uint64_t timestamp(const Payload& data)
+{
+    uint64_t ts;
+    memcpy(&ts, data.bytes(), sizeof ts);
+    return ts;
+}
+
+double percentile(const vector<uint64_t>& sorted, double p)
+{
+    if (sorted.empty()) return 0;
+    size_t i = min<size_t>(sorted.size() - 1, p * sorted.size());
+    return sorted[i] / 1000.0;
+}
+
+
+/******************************************************************************/
+/* BENCH                                                                      */
+/******************************************************************************/
+
+struct Run
+{
+    Endpoint::Backend backend;
+    size_t connections;
+    size_t size;
+    size_t depth;
+    size_t threads;
+};
+
+struct Result
+{
+    double elapsed;
+    size_t msgs;
+    size_t bytes;
+    size_t dropped;
+    vector<uint64_t> latencies;
+};
+
+Result bench(const Config& config, const Run& run, Port port)
+{
+    Endpoint provider(port, false, run.backend);
+    provider.onPayload = [&] (int fd, Payload&& data) {
+        provider.send(fd, move(data));
+    };
+
+    struct Conn
+    {
+        int fd;
+        std::atomic<size_t> inFlight;
+        Conn() : fd(-1), inFlight(0) {}
+    };
+    unique_ptr<Conn[]> conns(new Conn[run.connections]);
+
+    // Only touched from the client's poll thread.
+    Result result;
+    result.msgs = result.bytes = 0;
+    result.latencies.reserve(1 << 20);
+
+    // Off-thread sends are dropped from the sending thread.
+    std::atomic<size_t> dropped(0);
+
+    std::atomic<bool> measuring(false);
+    std::atomic<bool> done(false);
+
+    Endpoint client(run.backend);
+
+    auto findConn = [&] (int fd) -> Conn& {
+        for (size_t i = 0; i < run.connections; ++i)
+            if (conns[i].fd == fd) return conns[i];
+        abort();
+    };
+
+    client.onPayload = [&] (int fd, Payload&& data) {
+        if (measuring) {
+            result.msgs++;
+            result.bytes += data.packetSize();
+            result.latencies.push_back(nowNs() - timestamp(data));
+        }
+
+        findConn(fd).inFlight--;
+        if (!run.threads && !done) {
+            findConn(fd).inFlight++;
+            client.send(fd, makePayload(run.size));
+        }
+    };
+
+    client.onDroppedPayload = [&] (int fd, Payload&&) {
+        if (measuring) dropped++;
+        findConn(fd).inFlight--;
+    };
+
+    PollThread provPoller;
+    provPoller.add(provider);
+    provPoller.run();
+
+    for (size_t i = 0; i < run.connections; ++i)
+        conns[i].fd = client.connect(Address("localhost", port));
+
+    PollThread clientPoller;
+    clientPoller.add(client);
+    clientPoller.run();
+
+    vector<thread> senders;
+
+    if (!run.threads) {
+        for (size_t i = 0; i < run.connections; ++i) {
+            conns[i].inFlight += run.depth;
+            for (size_t j = 0; j < run.depth; ++j)
+                client.send(conns[i].fd, makePayload(run.size));
+        }
+    }
+
+    for (size_t id = 0; id < run.threads; ++id) {
+        senders.emplace_back([&, id] {
+            while (!done) {
+                for (size_t i = id; i < run.connections; i += run.threads) {
+                    auto& conn = conns[i];
+                    while (conn.inFlight < run.depth) {
+                        conn.inFlight++;
+                        client.send(conn.fd, makePayload(run.size));
+                    }
+                }
+
+                // A full defer queue drops the payloads right away so there's
+                // no point in hammering it until the poll thread catches up.
+                this_thread::yield();
+            }
+        });
+    }
+
+    lockless::sleep(config.warmupMs);
+
+    measuring = true;
+    uint64_t start = nowNs();
+
+    lockless::sleep(config.durationMs);
+
+    measuring = false;
+    result.elapsed = (nowNs() - start) / 1e9;
+
+    // The endpoints only yield to their poll thread once the traffic dies.
+    done = true;
+    for (auto& th : senders) th.join();
+    clientPoller.join();
+    provPoller.join();
+
+    result.dropped = dropped;
+    sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+void print(const Run& run, const Result& result, bool first)
+{
+    const auto& lat = result.latencies;
+
+    printf("%s\n  {\n", first ? "[" : ",");
+    printf("    \"backend\": \"%s\",\n", backendName(run.backend));
+    printf("    \"connections\": %zu,\n", run.connections);
+    printf("    \"size\": %zu,\n", run.size);
+    printf("    \"depth\": %zu,\n", run.depth);
+    printf("    \"threads\": %zu,\n", run.threads);
+    printf("    \"elapsed_s\": %.3f,\n", result.elapsed);
+    printf("    \"msgs\": %zu,\n", result.msgs);
+    printf("    \"dropped\": %zu,\n", result.dropped);
+    printf("    \"msgs_per_sec\": %.0f,\n", result.msgs / result.elapsed);
+    printf("    \"bytes_per_sec\": %.0f,\n", result.bytes / result.elapsed);
+    printf("    \"latency_us\": {\n");
+    printf("      \"p50\": %.1f,\n", percentile(lat, 0.5));
+    printf("      \"p99\": %.1f,\n", percentile(lat, 0.99));
+    printf("      \"p999\": %.1f,\n", percentile(lat, 0.999));
+    printf("      \"max\": %.1f\n", lat.empty() ? 0 : lat.back() / 1000.0);
+    printf("    }\n  }");
+    fflush(stdout);
+}
+
+
+/******************************************************************************/
+/* MAIN                                                                       */
+/******************************************************************************/
+
+int main(int argc, char** argv)
+{
+    Config config = parseArgs(argc, argv);
+    Port port = config.port;
+    bool first = true;
+
+    for (auto backend : config.backends)
+    for (size_t connections : config.connections)
+    for (size_t size : config.sizes)
+    for (size_t depth : config.depths)
+    for (size_t threads : config.threads) {
+        Run run = { backend, connections, size, depth, threads };
+
+        fprintf(stderr, "%s: conns=%zu size=%zu depth=%zu threads=%zu\n",
+                backendName(backend), connections, size, depth, threads);
+
+        Result result = bench(config, run, port++);
+        print(run, result, first);
+        first = false;
+    }
+
+    printf("%s]\n", first ? "[" : "\n");
+    return 0;
+}
@@ -9,6 +9,7 @@
 #define BOOST_TEST_DYN_LINK
 
 #include "endpoint.h"
+#include "sharded_endpoint.h"
 #include "pack.h"
 #include "utils.h"
 #include "test_utils.h"
@@ -16,6 +17,7 @@
 #include "lockless/tm.h"
 
 #include <boost/test/unit_test.hpp>
+#include <set>
 
 using namespace std;
 using namespace slick;
@@ -191,6 +193,746 @@ BOOST_AUTO_TEST_CASE(n_to_n)
 }
 
 
+BOOST_AUTO_TEST_CASE(send_queue)
+{
+    cerr << fmtTitle("send_queue", '=') << endl;
+
+    const Port listenPort = portCounter++;
+
+    enum { Payloads = 200 };
+
+    PollThread poller;
+
+    std::atomic<size_t> recv(0);
+    std::atomic<bool> ordered(true);
+
+    Endpoint provider(listenPort);
+    poller.add(provider);
+
+    provider.onPayload = [&] (int, Payload&& data) {
+        if (unpack<size_t>(data) != recv) ordered = false;
+        recv++;
+    };
+
+    poller.run();
+
+    // Not polled by a thread so every send is issued from the poll thread
+    // and queued until the connection becomes writable.
+    Endpoint client;
+    client.onDroppedPayload = [] (int, Payload&&) { assert(false); };
+
+    int fd = client.connect(Address("localhost", listenPort));
+    for (size_t i = 0; i < Payloads; ++i)
+        client.send(fd, pack(i));
+
+    while (recv != Payloads) client.poll(1);
+
+    poller.join();
+
+    BOOST_CHECK(ordered);
+}
+
+
+BOOST_AUTO_TEST_CASE(watermarks)
+{
+    cerr << fmtTitle("watermarks", '=') << endl;
+
+    const Port listenPort = portCounter++;
+
+    enum { Payloads = 25, Queued = 19 };
+
+    PollThread poller;
+
+    std::atomic<size_t> recv(0);
+
+    Endpoint provider(listenPort);
+    poller.add(provider);
+    provider.onPayload = [&] (int, Payload&&) { recv++; };
+
+    poller.run();
+
+    size_t high = 0, low = 0, dropped = 0;
+
+    Endpoint client;
+    client.queueLimits(Endpoint::QueueLimits(100, 1000, 2000));
+    client.onHighWatermark = [&] (int fd) { BOOST_CHECK_NE(fd, -1); high++; };
+    client.onLowWatermark = [&] (int fd) { BOOST_CHECK_NE(fd, -1); low++; };
+    client.onDroppedPayload = [&] (int, Payload&&) { dropped++; };
+
+    // Each packet is 103 bytes and they'll all get queued until the connection
+    // becomes writable.
+    int fd = client.connect(Address("localhost", listenPort));
+    for (size_t i = 0; i < Payloads; ++i)
+        client.send(fd, pack(string(98, 'a')));
+
+    BOOST_CHECK_EQUAL(high, 1);
+    BOOST_CHECK_EQUAL(low, 0);
+    BOOST_CHECK_EQUAL(dropped, Payloads - Queued);
+    BOOST_CHECK_EQUAL(client.queuedBytes(fd), Queued * 103);
+    BOOST_CHECK_EQUAL(client.queuedBytes(), Queued * 103);
+
+    while (recv != Queued) client.poll(1);
+
+    BOOST_CHECK_EQUAL(low, 1);
+    BOOST_CHECK_EQUAL(client.queuedBytes(), 0);
+
+    poller.join();
+}
+
+BOOST_AUTO_TEST_CASE(max_bytes_mid_frame)
+{
+    cerr << fmtTitle("max_bytes_mid_frame", '=') << endl;
+
+    const Port listenPort = portCounter++;
+
+    // Large enough to fill up the socket buffers of both sides.
+    enum { Size = 1 << 24, Max = 1 << 16 };
+
+    PollThread poller;
+
+    std::atomic<size_t> recv(0);
+    std::atomic<bool> valid(true);
+
+    // Not polled until the frame is stuck half-way.
+    Endpoint provider(listenPort);
+    poller.add(provider);
+    provider.onPayload = [&] (int, Payload&& data) {
+        string msg = unpack<string>(data);
+        if (msg.empty()) return;
+
+        if (msg.size() != Size || msg != string(Size, 'a' + recv)) valid = false;
+        recv++;
+    };
+
+    size_t dropped = 0;
+
+    Endpoint client;
+    client.queueLimits(Endpoint::QueueLimits(Max / 4, Max / 2, Max));
+    client.onDroppedPayload = [&] (int, Payload&&) { dropped++; };
+
+    int fd = client.connect(Address("localhost", listenPort));
+    client.send(fd, pack(string()));
+    while (client.queuedBytes(fd)) client.poll(1);
+
+    client.send(fd, pack(string(Size, 'a')));
+    BOOST_CHECK_EQUAL(dropped, 0);
+    BOOST_CHECK_GT(client.queuedBytes(fd), Max);
+
+    // Only the partly sent frame gets to go over the limit.
+    client.send(fd, pack(string(Size, 'b')));
+    BOOST_CHECK_EQUAL(dropped, 1);
+
+    poller.run();
+
+    while (client.queuedBytes(fd)) client.poll(1);
+    client.send(fd, pack(string(Size, 'b')));
+    while (recv != 2) client.poll(1);
+
+    BOOST_CHECK(valid);
+    BOOST_CHECK_EQUAL(dropped, 1);
+
+    poller.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(partial_frames)
+{
+    cerr << fmtTitle("partial_frames", '=') << endl;
+
+    const Port listenPort = portCounter++;
+
+    enum { Payloads = 64, Size = 60000 };
+
+    PollThread poller;
+
+    std::atomic<size_t> recv(0);
+    std::atomic<bool> valid(true);
+
+    Endpoint provider(listenPort);
+    poller.add(provider);
+
+    // Frames are larger then the receive buffer's default capacity so they're
+    // guaranteed to straddle reads.
+    provider.onPayload = [&] (int, Payload&& data) {
+        string msg = unpack<string>(data);
+        if (msg.size() != Size || msg != string(Size, 'a' + recv % 26))
+            valid = false;
+        recv++;
+    };
+
+    poller.run();
+
+    Endpoint client;
+    client.onDroppedPayload = [] (int, Payload&&) { assert(false); };
+
+    int fd = client.connect(Address("localhost", listenPort));
+    for (size_t i = 0; i < Payloads; ++i)
+        client.send(fd, pack(string(Size, 'a' + i % 26)));
+
+    while (recv != Payloads) client.poll(1);
+
+    poller.join();
+
+    BOOST_CHECK(valid);
+}
+
+
+BOOST_AUTO_TEST_CASE(large_payloads)
+{
+    cerr << fmtTitle("large_payloads", '=') << endl;
+
+    const Port wholePort = portCounter++;
+    const Port streamPort = portCounter++;
+
+    enum { Payloads = 8, Size = 1U << 20, Threshold = 1U << 16 };
+
+    auto expected = [] (size_t i) {
+        return i % 2 ? string(10, 'a' + i) : string(Size, 'a' + i);
+    };
+
+    PollThread poller;
+
+    std::atomic<size_t> wholeRecv(0);
+    std::atomic<bool> wholeValid(true);
+
+    Endpoint whole(wholePort);
+    poller.add(whole);
+
+    whole.onPayload = [&] (int, Payload&& data) {
+        if (unpack<string>(data) != expected(wholeRecv)) wholeValid = false;
+        wholeRecv++;
+    };
+
+    std::atomic<size_t> streamRecv(0);
+    std::atomic<bool> streamValid(true);
+    std::atomic<size_t> chunks(0);
+    string partial;
+
+    Endpoint stream(streamPort);
+    poller.add(stream);
+    stream.chunkThreshold(Threshold);
+
+    stream.onPayload = [&] (int, Payload&& data) {
+        if (!partial.empty()) streamValid = false;
+        if (unpack<string>(data) != expected(streamRecv)) streamValid = false;
+        streamRecv++;
+    };
+    stream.onPayloadChunk = [&] (int, const PayloadChunk& chunk) {
+        if (chunk.offset != partial.size()) streamValid = false;
+        partial.append(reinterpret_cast<const char*>(chunk.data), chunk.size);
+        chunks++;
+
+        if (!chunk.last()) return;
+
+        // Strings are packed with a trailing null.
+        if (partial != expected(streamRecv) + '\0') streamValid = false;
+        partial.clear();
+        streamRecv++;
+    };
+
+    poller.run();
+
+    Endpoint client;
+    client.onDroppedPayload = [] (int, Payload&&) { assert(false); };
+
+    int wholeFd = client.connect(Address("localhost", wholePort));
+    int streamFd = client.connect(Address("localhost", streamPort));
+
+    for (size_t i = 0; i < Payloads; ++i) {
+        Payload data = pack(expected(i));
+        client.send(wholeFd, data);
+        client.send(streamFd, std::move(data));
+    }
+
+    while (wholeRecv != Payloads || streamRecv != Payloads)
+        client.poll(1);
+
+    poller.join();
+
+    BOOST_CHECK(wholeValid);
+    BOOST_CHECK(streamValid);
+    BOOST_CHECK_GT(chunks, Payloads / 2);
+}
+
+
+BOOST_AUTO_TEST_CASE(payload_batch)
+{
+    cerr << fmtTitle("payload_batch", '=') << endl;
+
+    const Port listenPort = portCounter++;
+
+    enum { Payloads = 1000 };
+
+    PollThread poller;
+
+    std::atomic<size_t> recv(0);
+    std::atomic<size_t> batches(0);
+    std::atomic<bool> valid(true);
+
+    Endpoint provider(listenPort);
+    poller.add(provider);
+
+    provider.onPayload = [&] (int, Payload&&) { valid = false; };
+    provider.onPayloadBatch = [&] (int, PayloadSpan batch) {
+        if (batch.empty()) valid = false;
+
+        for (auto& data : batch) {
+            if (unpack<size_t>(data) != recv) valid = false;
+            recv++;
+        }
+        batches++;
+    };
+
+    poller.run();
+
+    Endpoint client;
+    int fd = client.connect(Address("localhost", listenPort));
+    for (size_t i = 0; i < Payloads; ++i)
+        client.send(fd, pack(i));
+
+    while (recv != Payloads) client.poll(1);
+
+    poller.join();
+
+    BOOST_CHECK(valid);
+    BOOST_CHECK_LE(batches, Payloads);
+}
+
+
+BOOST_AUTO_TEST_CASE(read_budget)
+{
+    cerr << fmtTitle("read_budget", '=') << endl;
+
+    const Port listenPort = portCounter++;
+
+    enum { Payloads = 1000, Budget = 1 << 10 };
+
+    // Nothing is polled by a thread so that everything can be written out
+    // before the provider reads anything.
+    Endpoint provider(listenPort);
+    provider.readBudget(Budget);
+
+    size_t connected = 0;
+    provider.onNewConnection = [&] (int) { connected++; };
+
+    Endpoint loud, quiet;
+    int loudFd = loud.connect(Address("localhost", listenPort));
+    int quietFd = quiet.connect(Address("localhost", listenPort));
+
+    while (connected != 2) {
+        provider.poll(1);
+        loud.poll();
+        quiet.poll();
+    }
+
+    size_t loudRecv = 0;
+    size_t quietAt = -1;
+    bool ordered = true;
+
+    provider.onPayload = [&] (int, Payload&& data) {
+        if (data.size() == 1) { quietAt = loudRecv; return; }
+        if (unpack<size_t>(data) != loudRecv) ordered = false;
+        loudRecv++;
+    };
+
+    for (size_t i = 0; i < Payloads; ++i)
+        loud.send(loudFd, pack(i));
+    quiet.send(quietFd, pack(uint8_t(0)));
+
+    while (loud.queuedBytes() || quiet.queuedBytes()) {
+        loud.poll(1);
+        quiet.poll(1);
+    }
+
+    while (loudRecv != Payloads || quietAt == size_t(-1)) provider.poll(1);
+
+    // The quiet connection only had to wait on a budget's worth of reads.
+    BOOST_CHECK(ordered);
+    BOOST_CHECK_LT(quietAt, Payloads);
+}
+
+BOOST_AUTO_TEST_CASE(read_pause)
+{
+    cerr << fmtTitle("read_pause", '=') << endl;
+
+    enum { Payloads = 1024, Size = 1 << 10, Low = 1 << 12, High = 1 << 14 };
+
+    for (auto backend : { Endpoint::Backend::Epoll, Endpoint::Backend::Uring }) {
+        const Port listenPort = portCounter++;
+
+        PollThread poller;
+
+        std::atomic<int> provFd(-1);
+        std::atomic<size_t> recv(0);
+
+        Endpoint provider(listenPort, false, backend);
+        provider.pendingLimits(Low, High);
+        provider.onNewConnection = [&] (int fd) { provFd = fd; };
+
+        // Payloads are never consumed unless we say so.
+        provider.onPayload = [&] (int, Payload&&) { recv++; };
+
+        poller.add(provider);
+        poller.run();
+
+        Endpoint client;
+        client.onDroppedPayload = [] (int, Payload&&) { assert(false); };
+
+        int fd = client.connect(Address("localhost", listenPort));
+        while (provFd < 0) client.poll(1);
+
+        auto stalls = [&] {
+            size_t before = recv;
+            for (size_t i = 0; i < 100; ++i) client.poll(1);
+            return recv == before;
+        };
+
+        // Manual pause.
+        provider.pauseReads(provFd);
+        client.send(fd, Payload(Size));
+        BOOST_CHECK(stalls());
+        BOOST_CHECK_EQUAL(recv, 0);
+
+        provider.resumeReads(provFd);
+        while (recv != 1) client.poll(1);
+
+        // Automatic pause once enough payloads are held on to.
+        for (size_t i = 1; i < Payloads; ++i)
+            client.send(fd, Payload(Size));
+
+        while (!stalls());
+        BOOST_CHECK_LT(recv, Payloads);
+
+        size_t consumed = 0;
+        while (recv != Payloads) {
+            size_t n = recv;
+            provider.consumed(provFd, (n - consumed) * Size);
+            consumed = n;
+
+            client.poll(1);
+        }
+
+        poller.join();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(credits)
+{
+    cerr << fmtTitle("credits", '=') << endl;
+
+    enum { Payloads = 256, Size = 1 << 10, Window = 1 << 14 };
+
+    for (auto backend : { Endpoint::Backend::Epoll, Endpoint::Backend::Uring }) {
+        const Port listenPort = portCounter++;
+
+        PollThread poller;
+
+        std::atomic<int> provFd(-1);
+        std::atomic<size_t> recv(0);
+
+        // Credits are only handed back once the payloads are consumed.
+        Endpoint provider(listenPort, false, backend);
+        provider.creditWindow(Window);
+        provider.pendingLimits(Payloads * Size, Payloads * Size);
+        provider.onNewConnection = [&] (int fd) { provFd = fd; };
+        provider.onPayload = [&] (int, Payload&&) { recv++; };
+
+        poller.add(provider);
+        poller.run();
+
+        Endpoint client;
+        client.creditWindow(Window);
+        client.onDroppedPayload = [] (int, Payload&&) { assert(false); };
+
+        int fd = client.connect(Address("localhost", listenPort));
+        while (provFd < 0) client.poll(1);
+        while (!client.creditStats(fd).credits) client.poll(1);
+
+        for (size_t i = 0; i < Payloads; ++i)
+            client.send(fd, Payload(Size));
+
+        auto stats = client.creditStats(fd);
+        BOOST_CHECK_EQUAL(stats.received, Window);
+        BOOST_CHECK_LE(stats.credits, 0);
+        BOOST_CHECK_GT(stats.heldPayloads, 0);
+        BOOST_CHECK_EQUAL(stats.heldPayloads, stats.stalls);
+        BOOST_CHECK_EQUAL(stats.heldBytes, stats.heldPayloads * (Size + 4));
+
+        for (size_t i = 0; i < 100; ++i) client.poll(1);
+        BOOST_CHECK_LE(recv, Window / Size);
+
+        size_t consumed = 0;
+        while (recv != Payloads) {
+            size_t n = recv;
+            provider.consumed(provFd, (n - consumed) * Size);
+            consumed = n;
+
+            client.poll(1);
+        }
+
+        stats = client.creditStats(fd);
+        BOOST_CHECK_EQUAL(stats.heldPayloads, 0);
+        BOOST_CHECK_EQUAL(stats.heldBytes, 0);
+        BOOST_CHECK_GE(stats.received, (Payloads - Window / Size) * Size);
+        poller.join();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(spin)
+{
+    cerr << fmtTitle("spin", '=') << endl;
+
+    const Port listenPort = portCounter++;
+
+    enum { Pings = 64, Budget = 1000 };
+
+    PollThread poller;
+    poller.pin(0);
+
+    Endpoint provider(listenPort);
+    provider.spin(Budget);
+    provider.onPayload = [&] (int fd, Payload&& data) {
+        provider.send(fd, std::move(data));
+    };
+
+    poller.add(provider);
+    poller.run();
+
+    Endpoint client;
+    client.spin(Budget);
+
+    size_t pongs = 0;
+    client.onPayload = [&] (int, Payload&&) { pongs++; };
+
+    int fd = client.connect(Address("localhost", listenPort));
+
+    // Ping-pong keeps the client spinning on each round trip.
+    for (size_t i = 0; i < Pings; ++i) {
+        client.send(fd, pack(i));
+        while (pongs == i) client.poll(1);
+    }
+
+    auto stats = client.spinStats();
+    BOOST_CHECK_GT(stats.spinning, 0);
+    BOOST_CHECK_GT(stats.spinWakeups, 0);
+
+    // Nothing is coming so the spin runs its course before blocking. Stray
+    // events or a preempted spin can still cut a single poll short.
+    for (size_t i = 0; i < 10; ++i) {
+        client.poll(10);
+        if (client.spinStats().blocking > stats.blocking) break;
+    }
+    BOOST_CHECK_GT(client.spinStats().blocking, stats.blocking);
+
+    poller.join();
+}
+
+BOOST_AUTO_TEST_CASE(uring)
+{
+    cerr << fmtTitle("uring", '=') << endl;
+
+    const Port listenPort = portCounter++;
+
+    enum { Payloads = 64, Size = 60000 };
+
+    PollThread poller;
+
+    std::atomic<size_t> recv(0), echoed(0);
+    std::atomic<bool> valid(true);
+    std::atomic<bool> gotClient(false), lostClient(false);
+
+    Endpoint provider(listenPort, false, Endpoint::Backend::Uring);
+    poller.add(provider);
+
+    provider.onNewConnection = [&] (int) { gotClient = true; };
+    provider.onLostConnection = [&] (int) { lostClient = true; };
+
+    // Echoing large frames back fills up the socket buffers which forces the
+    // sends through the ring.
+    provider.onPayload = [&] (int fd, Payload&& data) {
+        string msg = unpack<string>(data);
+        if (msg.size() != Size || msg != string(Size, 'a' + recv % 26))
+            valid = false;
+        recv++;
+
+        provider.send(fd, move(data));
+    };
+
+    poller.run();
+
+    auto client = make_shared<Endpoint>(Endpoint::Backend::Uring);
+    client->onDroppedPayload = [] (int, Payload&&) { assert(false); };
+    client->onPayload = [&] (int, Payload&& data) {
+        if (unpack<string>(data) != string(Size, 'a' + echoed % 26))
+            valid = false;
+        echoed++;
+    };
+
+    int fd = client->connect(Address("localhost", listenPort));
+    for (size_t i = 0; i < Payloads; ++i)
+        client->send(fd, pack(string(Size, 'a' + i % 26)));
+
+    while (echoed != Payloads) client->poll(1);
+    BOOST_CHECK(gotClient);
+
+    client.reset();
+    while (!lostClient);
+
+    poller.join();
+
+    BOOST_CHECK_EQUAL(recv, Payloads);
+    BOOST_CHECK(valid);
+}
+
+
+BOOST_AUTO_TEST_CASE(sharded)
+{
+    cerr << fmtTitle("sharded", '=') << endl;
+
+    const Port listenPort = portCounter++;
+
+    enum { Shards = 4, Clients = 32 };
+
+    ShardedEndpoint provider(Shards, listenPort);
+
+    provider.onPayload = [&] (int fd, Payload&& data) {
+        provider.send(fd, move(data));
+    };
+
+    provider.onDroppedPayload = [] (int, Payload&&) {
+        assert(false);
+    };
+
+    provider.run();
+
+
+    std::atomic<size_t> connected(0);
+    std::atomic<size_t> idSum(0);
+
+    ShardedEndpoint client(Shards);
+
+    client.onNewConnection = [&] (int) { connected++; };
+    client.onPayload = [&] (int, Payload&& data) {
+        idSum += unpack<size_t>(data);
+    };
+
+    client.run();
+
+    std::vector<int> fds;
+    for (size_t i = 0; i < Clients; ++i)
+        fds.push_back(client.connect(Address("localhost", listenPort)));
+
+    while (connected != Clients);
+
+    for (size_t i = 0; i < Clients; ++i)
+        client.send(fds[i], pack<size_t>(i + 1));
+
+    size_t exp = (Clients * (Clients + 1)) / 2;
+    while (idSum != exp);
+
+    client.broadcast(pack<size_t>(1));
+    while (idSum != exp + Clients);
+
+    client.join();
+    provider.join();
+}
+
+BOOST_AUTO_TEST_CASE(sharded_chunks)
+{
+    cerr << fmtTitle("sharded_chunks", '=') << endl;
+
+    const Port listenPort = portCounter++;
+
+    enum { Shards = 2, Size = 1 << 22 };
+
+    ShardedEndpoint provider(Shards, listenPort);
+
+    std::atomic<size_t> bytes(0), payloads(0);
+    std::atomic<bool> done(false);
+
+    provider.onPayload = [&] (int, Payload&&) { payloads++; };
+    provider.onPayloadChunk = [&] (int, const PayloadChunk& chunk) {
+        bytes += chunk.size;
+        if (chunk.last()) done = true;
+    };
+
+    provider.run();
+
+    PollThread poller;
+    Endpoint client;
+    poller.add(client);
+
+    int fd = client.connect(Address("localhost", listenPort));
+    poller.run();
+
+    Payload data(Size);
+    std::fill(data.begin(), data.end(), 0xAA);
+    client.send(fd, std::move(data));
+
+    for (size_t i = 0; i < 1000 && !done; ++i) lockless::sleep(1);
+
+    BOOST_CHECK(done);
+    BOOST_CHECK_EQUAL(bytes, Size);
+    BOOST_CHECK_EQUAL(payloads, 0);
+
+    poller.join();
+    provider.join();
+}
+
+
+BOOST_AUTO_TEST_CASE(timeouts)
+{
+    cerr << fmtTitle("timeouts", '=') << endl;
+
+    const Port readPort = portCounter++;
+    const Port idlePort = portCounter++;
+
+    PollThread poller;
+
+    std::atomic<size_t> recv(0);
+
+    // Only heartbeats keep connections alive on the first one and they're not
+    // good enough for the second one.
+    Endpoint readProvider(readPort);
+    readProvider.timeouts(Endpoint::Timeouts(0, 0.2, 0));
+    readProvider.onPayload = [&] (int, Payload&&) { recv++; };
+    poller.add(readProvider);
+
+    Endpoint idleProvider(idlePort);
+    idleProvider.timeouts(Endpoint::Timeouts(0.2, 0, 0));
+    idleProvider.onPayload = [&] (int, Payload&&) { recv++; };
+    poller.add(idleProvider);
+
+    poller.run();
+
+    std::set<int> lost;
+
+    Endpoint quiet;
+    quiet.onLostConnection = [&] (int fd) { lost.insert(fd); };
+
+    Endpoint beating;
+    beating.timeouts(Endpoint::Timeouts(0, 0, 0.05));
+    beating.onLostConnection = [&] (int fd) { lost.insert(fd); };
+
+    int quietFd = quiet.connect(Address("localhost", readPort));
+    int beatingFd = beating.connect(Address("localhost", readPort));
+    int beatingIdleFd = beating.connect(Address("localhost", idlePort));
+
+    for (size_t i = 0; i < 60; ++i) {
+        quiet.poll();
+        beating.poll();
+        lockless::sleep(10);
+    }
+
+    poller.join();
+
+    BOOST_CHECK(lost.count(quietFd));
+    BOOST_CHECK(!lost.count(beatingFd));
+    BOOST_CHECK(lost.count(beatingIdleFd));
+    BOOST_CHECK_EQUAL(recv, 0);
+}
+
+
 BOOST_AUTO_TEST_CASE(nice_disconnect)
 {
     cerr << fmtTitle("nice_disconnecct", '=') << endl;
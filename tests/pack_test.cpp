@@ -169,6 +169,27 @@ BOOST_AUTO_TEST_CASE(payloads)
     }
 }
 
+BOOST_AUTO_TEST_CASE(shared_payloads)
+{
+    Payload value = pack(std::string("bleh"));
+
+    {
+        Payload copy(value);
+        BOOST_CHECK_EQUAL(copy.bytes(), value.bytes());
+
+        Payload other;
+        other = copy;
+        BOOST_CHECK_EQUAL(other.bytes(), value.bytes());
+    }
+
+    // The copies going away shouldn't affect the original.
+    BOOST_CHECK_EQUAL(unpack<std::string>(value), "bleh");
+
+    Payload empty;
+    Payload emptyCopy(empty);
+    BOOST_CHECK(!emptyCopy);
+}
+
 
 /******************************************************************************/
 /* CUSTOM                                                                     */
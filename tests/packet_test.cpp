@@ -6,13 +6,16 @@
 */
 
 #include "endpoint.h"
+#include "sharded_endpoint.h"
 #include "pack.h"
 #include "test_utils.h"
 #include "lockless/format.h"
 #include "lockless/tm.h"
 
+#include <atomic>
 #include <vector>
 #include <string>
+#include <functional>
 #include <cstdlib>
 #include <cassert>
 
@@ -45,11 +48,10 @@ string getStats(size_t value, size_t& oldValue)
 /* PROVIDER                                                                   */
 /******************************************************************************/
 
-void runProvider(Port port)
+template<typename Provider>
+void runProvider(Provider& provider, const std::function<void()>& pollFn)
 {
-    size_t recv = 0, dropped = 0;
-
-    Endpoint provider(port);
+    std::atomic<size_t> recv(0), dropped(0);
 
     provider.onNewConnection = [] (int fd) {
         fprintf(stderr, "\nprv: new %d\n", fd);;
@@ -66,7 +68,7 @@ void runProvider(Port port)
         dropped++;
     };
 
-    thread pollTh([&] { while (true) provider.poll(100); });
+    pollFn();
 
     double start = lockless::wall();
     size_t oldRecv = 0;
@@ -81,6 +83,23 @@ void runProvider(Port port)
     }
 }
 
+void runProvider(Port port, size_t shards)
+{
+    if (shards <= 1) {
+        Endpoint provider(port);
+
+        thread pollTh;
+        runProvider(provider, [&] {
+                    pollTh = thread([&] { while (true) provider.poll(100); });
+                });
+    }
+
+    else {
+        ShardedEndpoint provider(shards, port);
+        runProvider(provider, [&] { provider.run(); });
+    }
+}
+
 
 /******************************************************************************/
 /* CLIENT                                                                     */
@@ -148,7 +167,11 @@ int main(int argc, char** argv)
     if (argv[1][0] == 'p') {
         Port port = 30000;
         if (argc >= 3) port = atoi(argv[2]);
-        runProvider(port);
+
+        size_t shards = 1;
+        if (argc >= 4) shards = atoi(argv[3]);
+
+        runProvider(port, shards);
     }
 
     else if (argv[1][0] == 'c') {
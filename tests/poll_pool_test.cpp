@@ -0,0 +1,194 @@
+/* poll_pool_test.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Tests for the poll pool.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "poll_pool.h"
+#include "endpoint.h"
+#include "pack.h"
+#include "lockless/format.h"
+#include "lockless/tm.h"
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <iostream>
+
+using namespace std;
+using namespace slick;
+using namespace lockless;
+
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+namespace {
+
+struct Source
+{
+    Source(size_t sleepMs = 0) : sleepMs(sleepMs), polls(0), thread(0) {}
+
+    int fd() const { return notify.fd(); }
+
+    void poll()
+    {
+        if (!notify.poll()) return;
+        if (sleepMs) lockless::sleep(sleepMs);
+
+        thread = threadId();
+        polls++;
+    }
+
+    Notify notify;
+    size_t sleepMs;
+
+    std::atomic<size_t> polls;
+    std::atomic<size_t> thread;
+};
+
+// Thread-aware sources are never stolen.
+struct PinnedSource : public Source
+{
+    PinnedSource(size_t sleepMs = 0) : Source(sleepMs) {}
+
+    void startPolling() {}
+    void stopPolling() {}
+};
+
+} // namespace anonymous
+
+
+/******************************************************************************/
+/* TESTS                                                                      */
+/******************************************************************************/
+
+BOOST_AUTO_TEST_CASE(assignment)
+{
+    cerr << fmtTitle("assignment", '=') << endl;
+
+    enum { Threads = 4, Sources = 3 * Threads };
+
+    PollPool pool(Threads);
+    BOOST_CHECK_EQUAL(pool.threads(), Threads);
+
+    vector<unique_ptr<Source> > sources;
+    for (size_t i = 0; i < Sources; ++i) {
+        sources.emplace_back(new Source);
+        BOOST_CHECK_EQUAL(pool.add(*sources.back()), i % Threads);
+    }
+
+    pool.del(*sources.front());
+    BOOST_CHECK_EQUAL(pool.stats(0).sources, Sources / Threads - 1);
+
+    Source source;
+    BOOST_CHECK_EQUAL(pool.add(source), 0);
+
+    pool.run();
+
+    for (auto& source : sources) source->notify.signal();
+    for (size_t i = 1; i < Sources; ++i)
+        while (!sources[i]->polls) lockless::sleep(1);
+
+    pool.join();
+
+    BOOST_CHECK_EQUAL(sources.front()->polls, 0);
+}
+
+BOOST_AUTO_TEST_CASE(stealing)
+{
+    cerr << fmtTitle("stealing", '=') << endl;
+
+    PollPool pool(2);
+
+    PinnedSource slow(100);
+    Source fast;
+    Source stolen;
+
+    BOOST_CHECK_EQUAL(pool.add(slow), 0);
+    BOOST_CHECK_EQUAL(pool.add(fast), 1);
+    BOOST_CHECK_EQUAL(pool.add(stolen), 0);
+
+    pool.run();
+
+    // Keeps the first thread busy which leaves its other source to the
+    // second thread.
+    slow.notify.signal();
+    lockless::sleep(10);
+
+    stolen.notify.signal();
+    while (!stolen.polls) lockless::sleep(1);
+    BOOST_CHECK(!slow.polls);
+
+    while (!slow.polls) lockless::sleep(1);
+    pool.join();
+
+    BOOST_CHECK_NE(stolen.thread, slow.thread);
+    BOOST_CHECK_EQUAL(pool.stats(1).stolen, 1);
+    BOOST_CHECK_GT(pool.stats(0).busy, 0.05);
+}
+
+BOOST_AUTO_TEST_CASE(load)
+{
+    cerr << fmtTitle("load", '=') << endl;
+
+    PollPool pool(2);
+
+    PinnedSource slow(100);
+    Source a, b;
+
+    BOOST_CHECK_EQUAL(pool.add(slow), 0);
+    BOOST_CHECK_EQUAL(pool.add(a), 1);
+    BOOST_CHECK_EQUAL(pool.add(b), 0);
+    pool.del(b);
+
+    pool.run();
+
+    slow.notify.signal();
+    while (!slow.polls) lockless::sleep(1);
+
+    pool.join();
+
+    // Both threads have as many sources but the first one is busier.
+    Source c;
+    BOOST_CHECK_EQUAL(pool.add(c), 1);
+}
+
+BOOST_AUTO_TEST_CASE(endpoints)
+{
+    cerr << fmtTitle("endpoints", '=') << endl;
+
+    enum { Pings = 64 };
+    const Port listenPort = 20500;
+
+    PollPool pool(2);
+
+    Endpoint provider(listenPort);
+    provider.onPayload = [&] (int fd, Payload&& data) {
+        provider.send(fd, std::move(data));
+    };
+
+    std::atomic<int> fd(-1);
+    std::atomic<size_t> pongs(0);
+
+    Endpoint client;
+    client.onNewConnection = [&] (int conn) { fd = conn; };
+    client.onPayload = [&] (int, Payload&&) { pongs++; };
+
+    BOOST_CHECK_EQUAL(pool.add(provider), 0);
+    BOOST_CHECK_EQUAL(pool.add(client), 1);
+
+    pool.run();
+
+    client.connect(Address("localhost", listenPort));
+    while (fd < 0) lockless::sleep(1);
+
+    for (size_t i = 0; i < Pings; ++i) client.send(fd, pack(i));
+    while (pongs != Pings) lockless::sleep(1);
+
+    pool.join();
+}
@@ -0,0 +1,145 @@
+/* poll_test.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Tests for the epoll wrapper and the source poller.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "poll.h"
+#include "notify.h"
+#include "lockless/format.h"
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+using namespace slick;
+using namespace lockless;
+
+
+/******************************************************************************/
+/* EPOLL                                                                      */
+/******************************************************************************/
+
+BOOST_AUTO_TEST_CASE(batch_size)
+{
+    cerr << fmtTitle("batch_size", '=') << endl;
+
+    enum { Fds = 256, MaxEvents = 128 };
+
+    Epoll poller(MaxEvents);
+    BOOST_CHECK_EQUAL(poller.batchSize(), Epoll::MinEvents);
+
+    // Level-triggered and never cleared so every fd shows up in every wait.
+    vector<unique_ptr<Notify> > notifies;
+    for (size_t i = 0; i < Fds; ++i) {
+        notifies.emplace_back(new Notify);
+        notifies.back()->signal();
+        poller.add(notifies.back()->fd());
+    }
+
+    size_t events = 0;
+    for (size_t i = 0; i < 16 * Fds; ++i) {
+        if (!poller.poll()) break;
+        poller.next();
+        events++;
+    }
+
+    BOOST_CHECK_EQUAL(events, 16 * Fds);
+    BOOST_CHECK_EQUAL(poller.batchSize(), MaxEvents);
+
+    // Goes back down once things quiet down.
+    for (auto& notify : notifies) poller.del(notify->fd());
+    while (poller.pending()) poller.next();
+
+    for (size_t i = 0; i < 16 * Fds; ++i) BOOST_CHECK(!poller.poll());
+    BOOST_CHECK_EQUAL(poller.batchSize(), Epoll::MinEvents);
+}
+
+
+/******************************************************************************/
+/* SOURCE POLLER                                                              */
+/******************************************************************************/
+
+namespace {
+
+struct Source
+{
+    Source() : polls(0) { notify.signal(); }
+
+    int fd() const { return notify.fd(); }
+    void poll() { polls++; }
+
+    Notify notify;
+    size_t polls;
+};
+
+} // namespace anonymous
+
+BOOST_AUTO_TEST_CASE(source_dispatch)
+{
+    cerr << fmtTitle("source_dispatch", '=') << endl;
+
+    SourcePoller poller;
+
+    Source a, b;
+    poller.add(a);
+    poller.add(b);
+
+    // Sources removed midway through a batch don't see the rest of it.
+    Notify c;
+    size_t cPolls = 0;
+    c.signal();
+    poller.add(c.fd(), [&] {
+                cPolls++;
+                poller.del(a);
+                poller.del(b);
+            });
+
+    poller.poll();
+    BOOST_CHECK_EQUAL(cPolls, 1);
+    BOOST_CHECK_LE(a.polls + b.polls, 2);
+
+    size_t polls = a.polls + b.polls;
+    poller.poll();
+    BOOST_CHECK_EQUAL(cPolls, 2);
+    BOOST_CHECK_EQUAL(a.polls + b.polls, polls);
+}
+
+BOOST_AUTO_TEST_CASE(source_fd_reuse)
+{
+    cerr << fmtTitle("source_fd_reuse", '=') << endl;
+
+    SourcePoller poller;
+
+    // Both signaled so that they show up in the same batch.
+    unique_ptr<Notify> a(new Notify), b(new Notify);
+    a->signal();
+    b->signal();
+
+    unique_ptr<Notify> c;
+    size_t aPolls = 0, bPolls = 0, cPolls = 0;
+
+    // Closes the fd of the other source without removing it and hands the
+    // fd over to a new source while its event is still in the batch.
+    auto reuse = [&] (unique_ptr<Notify>& other) {
+        int fd = other->fd();
+        other.reset();
+
+        c.reset(new Notify);
+        BOOST_REQUIRE_EQUAL(c->fd(), fd);
+        poller.add(c->fd(), [&] { cPolls++; });
+    };
+
+    poller.add(a->fd(), [&] { aPolls++; reuse(b); });
+    poller.add(b->fd(), [&] { bPolls++; reuse(a); });
+
+    poller.poll();
+    BOOST_CHECK_EQUAL(aPolls + bPolls, 1);
+    BOOST_CHECK_EQUAL(cPolls, 0);
+}
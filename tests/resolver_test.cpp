@@ -0,0 +1,142 @@
+/* resolver_test.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Tests for the asynchronous resolver.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "resolver.h"
+#include "endpoint.h"
+#include "lockless/format.h"
+#include "lockless/tm.h"
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <sys/poll.h>
+
+using namespace std;
+using namespace slick;
+using namespace lockless;
+
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+template<typename Pred>
+void pollUntil(Resolver& resolver, Pred pred)
+{
+    struct pollfd pfd = { resolver.fd(), POLLIN, 0 };
+    while (!pred()) {
+        ::poll(&pfd, 1, 10);
+        resolver.poll();
+    }
+}
+
+
+/******************************************************************************/
+/* TESTS                                                                      */
+/******************************************************************************/
+
+BOOST_AUTO_TEST_CASE(numeric)
+{
+    cerr << fmtTitle("numeric", '=') << endl;
+
+    Resolver resolver;
+
+    size_t calls = 0;
+    resolver.resolve(Address("127.0.0.1", 20000), [&] (const SockAddrs& addrs) {
+        BOOST_CHECK(!addrs.empty());
+        calls++;
+    });
+
+    // Never leaves the calling thread nor lands in the cache.
+    BOOST_CHECK_EQUAL(calls, 1);
+    BOOST_CHECK_EQUAL(resolver.cached(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(cache)
+{
+    cerr << fmtTitle("cache", '=') << endl;
+
+    Resolver resolver;
+    Address addr("localhost", 20000);
+
+    size_t calls = 0;
+    auto fn = [&] (const SockAddrs& addrs) {
+        BOOST_CHECK(!addrs.empty());
+        calls++;
+    };
+
+    // Concurrent lookups are folded into one.
+    resolver.resolve(addr, fn);
+    resolver.resolve(addr, fn);
+    BOOST_CHECK_EQUAL(calls, 0);
+
+    pollUntil(resolver, [&] { return calls == 2; });
+    BOOST_CHECK_EQUAL(resolver.cached(), 1);
+
+    resolver.resolve(addr, fn);
+    BOOST_CHECK_EQUAL(calls, 3);
+
+    // Expired entries go back to the worker.
+    resolver.ttl(0.001);
+    resolver.resolve(Address("localhost", 20001), fn);
+    pollUntil(resolver, [&] { return calls == 4; });
+
+    lockless::sleep(20);
+    resolver.resolve(Address("localhost", 20001), fn);
+    BOOST_CHECK_EQUAL(calls, 4);
+    pollUntil(resolver, [&] { return calls == 5; });
+}
+
+BOOST_AUTO_TEST_CASE(failure)
+{
+    cerr << fmtTitle("failure", '=') << endl;
+
+    Resolver resolver;
+
+    bool failed = false;
+    resolver.connect(Address("invalid.", 20000), [&] (Socket&& socket) {
+        BOOST_CHECK(!socket);
+        failed = true;
+    });
+
+    pollUntil(resolver, [&] { return failed; });
+    BOOST_CHECK_EQUAL(resolver.cached(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(node_connect)
+{
+    cerr << fmtTitle("node_connect", '=') << endl;
+
+    const Port port = 20002;
+
+    Endpoint provider(port);
+    Endpoint client;
+
+    bool connected = false;
+    provider.onNewConnection = [&] (int) { connected = true; };
+
+    Resolver resolver;
+
+    // The bogus address is skipped for the next one in the node.
+    NodeAddress node = { Address("invalid.", port), Address("localhost", port) };
+
+    int fd = -1;
+    resolver.connect(node, [&] (Socket&& socket) {
+        BOOST_CHECK(socket);
+        fd = socket.fd();
+        client.connect(std::move(socket));
+    });
+
+    pollUntil(resolver, [&] { return fd >= 0; });
+
+    while (!connected) {
+        provider.poll();
+        client.poll();
+    }
+}
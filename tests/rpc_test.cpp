@@ -0,0 +1,255 @@
+/* rpc_test.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Tests for the rpc layer.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "rpc.h"
+#include "test_utils.h"
+#include "lockless/format.h"
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <string>
+
+using namespace std;
+using namespace slick;
+using namespace lockless;
+
+namespace { Port portCounter = 21000; }
+
+enum : Rpc::Method { Echo = 1, Length = 2, Missing = 3 };
+
+
+/******************************************************************************/
+/* TESTS                                                                      */
+/******************************************************************************/
+
+BOOST_AUTO_TEST_CASE(pipelining)
+{
+    cerr << fmtTitle("pipelining", '=') << endl;
+
+    enum { Calls = 1024 };
+    const Port listenPort = portCounter++;
+
+    PollThread poller;
+
+    Rpc server(listenPort);
+    server.handle<uint64_t, uint64_t>(Echo, [] (int, uint64_t&& value) {
+                return value;
+            });
+    server.handle<size_t, string>(Length, [] (int, string&& value) {
+                return value.size();
+            });
+
+    poller.add(server);
+    poller.run();
+
+    Rpc client;
+    int fd = client.connect(Address("localhost", listenPort));
+    BOOST_CHECK(fd > 0);
+
+    size_t echoed = 0, ordered = 0;
+    for (uint64_t i = 0; i < Calls; ++i) {
+        client.call<uint64_t>(fd, Echo, i, [&, i] (Rpc::Status status, uint64_t&& value) {
+                    BOOST_CHECK(status == Rpc::Status::Ok);
+                    BOOST_CHECK_EQUAL(value, i);
+                    if (value == ordered) ordered++;
+                    echoed++;
+                });
+    }
+
+    size_t length = 0;
+    client.call<size_t>(fd, Length, string("blah"), [&] (Rpc::Status, size_t&& value) {
+                length = value;
+            });
+
+    // Every call is in flight at once over the same connection.
+    BOOST_CHECK_EQUAL(client.pending(), Calls + 1);
+
+    while (client.pending()) client.poll(1);
+
+    BOOST_CHECK_EQUAL(echoed, Calls);
+    BOOST_CHECK_EQUAL(ordered, Calls);
+    BOOST_CHECK_EQUAL(length, 4);
+
+    poller.join();
+}
+
+BOOST_AUTO_TEST_CASE(failures)
+{
+    cerr << fmtTitle("failures", '=') << endl;
+
+    const Port listenPort = portCounter++;
+    const Port silentPort = portCounter++;
+
+    PollThread poller;
+
+    Rpc server(listenPort);
+    poller.add(server);
+
+    // Swallows requests without ever answering.
+    Endpoint silent(silentPort);
+    silent.onPayload = [] (int, Payload&&) {};
+    poller.add(silent);
+
+    poller.run();
+
+    Rpc client(0.1);
+
+    vector<Rpc::Status> results;
+    auto record = [&] (Rpc::Status status, uint64_t&&) {
+        results.push_back(status);
+    };
+
+    int fd = client.connect(Address("localhost", listenPort));
+    client.call<uint64_t>(fd, Missing, uint64_t(0), record);
+    while (client.pending()) client.poll(1);
+
+    int silentFd = client.connect(Address("localhost", silentPort));
+    client.call<uint64_t>(silentFd, Echo, uint64_t(0), record);
+    while (client.pending()) client.poll(1);
+
+    client.call<uint64_t>(silentFd, Echo, uint64_t(0), record, 0);
+    client.disconnect(silentFd);
+    while (client.pending()) client.poll(1);
+
+    // Never was a connection and there's no deadline to fall back on.
+    client.call<uint64_t>(silentFd, Echo, uint64_t(0), record, 0);
+    while (client.pending()) client.poll(1);
+
+    BOOST_CHECK_EQUAL(results.size(), 4);
+    BOOST_CHECK(results[0] == Rpc::Status::UnknownMethod);
+    BOOST_CHECK(results[1] == Rpc::Status::Timeout);
+    BOOST_CHECK(results[2] == Rpc::Status::Disconnected);
+    BOOST_CHECK(results[3] == Rpc::Status::Disconnected);
+
+    poller.join();
+}
+
+BOOST_AUTO_TEST_CASE(deadlines)
+{
+    cerr << fmtTitle("deadlines", '=') << endl;
+
+    const Port silentPort = portCounter++;
+
+    PollThread poller;
+
+    Endpoint silent(silentPort);
+    silent.onPayload = [] (int, Payload&&) {};
+    poller.add(silent);
+    poller.run();
+
+    Rpc client;
+
+    double elapsed = 0;
+    bool timedOut = false;
+    int fd = client.connect(Address("localhost", silentPort));
+
+    for (double timeout : { 0.05, 0.2, 0.5 }) {
+        double start = monotonicTime();
+
+        client.call<uint64_t>(fd, Echo, uint64_t(0),
+                [&] (Rpc::Status status, uint64_t&&) {
+                    elapsed = monotonicTime() - start;
+                    timedOut = status == Rpc::Status::Timeout;
+                }, timeout);
+        while (client.pending()) client.poll(1);
+
+        BOOST_CHECK(timedOut);
+        BOOST_CHECK_GE(elapsed, timeout);
+        BOOST_CHECK_LT(elapsed, timeout + 0.1);
+    }
+
+    poller.join();
+}
+
+BOOST_AUTO_TEST_CASE(malformed)
+{
+    cerr << fmtTitle("malformed", '=') << endl;
+
+    const Port listenPort = portCounter++;
+
+    PollThread poller;
+
+    Rpc server(listenPort);
+    poller.add(server);
+    poller.run();
+
+    std::vector<Payload> messages;
+    messages.push_back(pack(uint8_t(1)));
+    messages.push_back(packAll(uint8_t(42), uint64_t(1), Rpc::Method(Echo)));
+
+    for (auto& msg : messages) {
+        Endpoint client;
+
+        bool lost = false;
+        client.onLostConnection = [&] (int) { lost = true; };
+
+        int fd = client.connect(Address("localhost", listenPort));
+        client.send(fd, std::move(msg));
+
+        for (size_t i = 0; i < 1000 && !lost; ++i) client.poll(1);
+        BOOST_CHECK(lost);
+    }
+
+    poller.join();
+}
+
+BOOST_AUTO_TEST_CASE(forged)
+{
+    cerr << fmtTitle("forged", '=') << endl;
+
+    const Port silentPort = portCounter++;
+    const Port forgerPort = portCounter++;
+
+    PollThread poller;
+
+    // Never answers but remembers the id of the call.
+    std::atomic<Rpc::CallId> callId(0);
+    Endpoint silent(silentPort);
+    silent.onPayload = [&] (int, Payload&& data) {
+        uint8_t type;
+        Rpc::CallId id;
+        unpackAll(data.cbegin(), data.cend(), type, id);
+        callId = id;
+    };
+
+    std::atomic<bool> accepted(false), lost(false);
+    Endpoint forger(forgerPort);
+    forger.onNewConnection = [&] (int) { accepted = true; };
+    forger.onLostConnection = [&] (int) { lost = true; };
+
+    poller.add(silent);
+    poller.add(forger);
+    poller.run();
+
+    Rpc client;
+    int silentFd = client.connect(Address("localhost", silentPort));
+    client.connect(Address("localhost", forgerPort));
+
+    size_t done = 0;
+    client.call<uint64_t>(silentFd, Echo, uint64_t(1), [&] (Rpc::Status, uint64_t&&) {
+                done++;
+            });
+    while (!callId || !accepted) client.poll(1);
+
+    // Answers a call that was never made to it.
+    Rpc::CallId id = callId;
+    forger.broadcast(packAll(uint8_t(2), id, Rpc::Method(Echo), uint64_t(1)));
+
+    for (size_t i = 0; i < 1000 && !lost; ++i) client.poll(1);
+    BOOST_CHECK(lost);
+    BOOST_CHECK_EQUAL(done, 0);
+    BOOST_CHECK_EQUAL(client.pending(), 1);
+
+    client.disconnect(silentFd);
+    for (size_t i = 0; i < 1000 && !done; ++i) client.poll(1);
+    BOOST_CHECK_EQUAL(done, 1);
+
+    poller.join();
+}
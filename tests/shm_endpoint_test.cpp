@@ -0,0 +1,288 @@
+/* shm_endpoint_test.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Tests for the shared memory endpoint.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "shm_endpoint.h"
+#include "pack.h"
+#include "lockless/format.h"
+#include "lockless/tm.h"
+
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/un.h>
+
+using namespace std;
+using namespace slick;
+using namespace lockless;
+
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+namespace {
+
+// Mirrors the layout of the ring header in the shared mapping.
+struct RingHeader
+{
+    alignas(64) uint64_t head;
+    alignas(64) uint64_t tail;
+    alignas(64) uint32_t readerIdle;
+    uint32_t writerBlocked;
+    uint64_t capacity;
+};
+
+/** Plays the connecting side by hand and hands over a mapping where the ring
+    read by the other side holds whatever garbage fill leaves in it.
+ */
+template<typename Fn>
+int connectRaw(
+        const std::string& name, size_t ringSize, Fn fill,
+        int seals = F_SEAL_SHRINK | F_SEAL_GROW)
+{
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+    std::string path = "slick.shm." + name;
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path + 1, path.data(), path.size());
+
+    socklen_t len = offsetof(struct sockaddr_un, sun_path) + 1 + path.size();
+    int ret = ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), len);
+    BOOST_REQUIRE(!ret);
+
+    size_t size = 2 * (sizeof(RingHeader) + ringSize);
+    int memFd = memfd_create("shm_test", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    BOOST_REQUIRE(!ftruncate(memFd, size));
+
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    BOOST_REQUIRE(map != MAP_FAILED);
+
+    uint8_t* start = static_cast<uint8_t*>(map);
+    for (size_t offset : { size_t(0), size / 2 }) {
+        auto ring = reinterpret_cast<RingHeader*>(start + offset);
+        ring->readerIdle = 1;
+        ring->capacity = ringSize;
+    }
+
+    auto ring = reinterpret_cast<RingHeader*>(start);
+    fill(*ring, reinterpret_cast<uint8_t*>(ring + 1));
+    BOOST_REQUIRE(!fcntl(memFd, F_ADD_SEALS, seals));
+
+    int fds[] = { memFd, eventfd(0, EFD_CLOEXEC) };
+
+    char byte = 0;
+    struct iovec iov = { &byte, sizeof byte };
+    char control[CMSG_SPACE(sizeof fds)];
+    std::memset(control, 0, sizeof control);
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof fds);
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+    BOOST_REQUIRE_EQUAL(sendmsg(fd, &msg, 0), 1);
+
+    munmap(map, size);
+    close(memFd);
+    close(fds[1]);
+    return fd;
+}
+
+} // namespace anonymous
+
+
+/******************************************************************************/
+/* TESTS                                                                      */
+/******************************************************************************/
+
+BOOST_AUTO_TEST_CASE(basics)
+{
+    cerr << fmtTitle("basics", '=') << endl;
+
+    // Small enough that the ring wraps and fills up many times over.
+    enum { RingSize = 1 << 12, Payloads = 1 << 14 };
+
+    PollThread poller;
+
+    std::atomic<int> provFd(-1);
+
+    ShmEndpoint provider("basics", RingSize);
+    provider.onNewConnection = [&] (int fd) { provFd = fd; };
+    provider.onPayload = [&] (int fd, Payload&& data) {
+        provider.send(fd, std::move(data));
+    };
+    provider.onDroppedPayload = [] (int, Payload&&) { BOOST_CHECK(false); };
+
+    poller.add(provider);
+    poller.run();
+
+    ShmEndpoint client(RingSize);
+    client.startPolling();
+
+    size_t recv = 0, ordered = 0;
+    client.onPayload = [&] (int, Payload&& data) {
+        if (unpack<uint64_t>(data) == ordered) ordered++;
+        recv++;
+    };
+    client.onDroppedPayload = [] (int, Payload&&) { BOOST_CHECK(false); };
+
+    BOOST_CHECK_EQUAL(client.connect("nobody"), 0);
+
+    // Queued until the handshake completes.
+    int fd = client.connect("basics");
+    BOOST_CHECK(fd > 0);
+    for (uint64_t i = 0; i < Payloads; ++i) client.send(fd, pack(i));
+
+    while (recv != Payloads) client.poll(1);
+    BOOST_CHECK_EQUAL(ordered, Payloads);
+    BOOST_CHECK(provFd > 0);
+
+    client.stopPolling();
+    poller.join();
+}
+
+BOOST_AUTO_TEST_CASE(disconnects)
+{
+    cerr << fmtTitle("disconnects", '=') << endl;
+
+    enum { RingSize = 1 << 12 };
+
+    PollThread poller;
+
+    std::atomic<int> provFd(-1);
+    std::atomic<size_t> lost(0);
+
+    ShmEndpoint provider("disconnects", RingSize);
+    provider.onNewConnection = [&] (int fd) { provFd = fd; };
+    provider.onLostConnection = [&] (int) { lost++; };
+    provider.onPayload = [] (int, Payload&&) {};
+
+    poller.add(provider);
+    poller.run();
+
+    ShmEndpoint client(RingSize);
+    client.startPolling();
+
+    size_t dropped = 0;
+    client.onDroppedPayload = [&] (int, Payload&&) { dropped++; };
+
+    int fd = client.connect("disconnects");
+    while (provFd < 0) client.poll(1);
+
+    // Can never fit in the ring.
+    client.send(fd, Payload(RingSize));
+    BOOST_CHECK_EQUAL(dropped, 1);
+
+    client.disconnect(fd);
+    while (!lost) client.poll(1);
+
+    client.send(fd, Payload(1));
+    BOOST_CHECK_EQUAL(dropped, 2);
+
+    client.stopPolling();
+    poller.join();
+}
+
+BOOST_AUTO_TEST_CASE(corrupt_ring)
+{
+    cerr << fmtTitle("corrupt_ring", '=') << endl;
+
+    enum { RingSize = 1 << 12 };
+
+    typedef std::function<void(RingHeader&, uint8_t*)> FillFn;
+    std::vector<FillFn> fills = {
+        // Frame larger than the ring.
+        [] (RingHeader& ring, uint8_t* data) {
+            Payload::SizeT size = 0x7FFFFFF0;
+            std::memcpy(data, &size, sizeof size);
+            ring.tail = sizeof size;
+        },
+
+        // Frame larger than what was written.
+        [] (RingHeader& ring, uint8_t* data) {
+            Payload::SizeT size = 16;
+            std::memcpy(data, &size, sizeof size);
+            ring.tail = sizeof size + 8;
+        },
+
+        // Tail too far ahead of the head.
+        [] (RingHeader& ring, uint8_t*) { ring.tail = RingSize + 1; },
+    };
+
+    for (auto& fill : fills) {
+        size_t recv = 0, lost = 0;
+
+        ShmEndpoint provider("corrupt_ring", RingSize);
+        provider.onPayload = [&] (int, Payload&&) { recv++; };
+        provider.onLostConnection = [&] (int) { lost++; };
+
+        int fd = connectRaw("corrupt_ring", RingSize, fill);
+        for (size_t i = 0; i < 100 && !lost; ++i) provider.poll(1);
+
+        BOOST_CHECK_EQUAL(recv, 0);
+        BOOST_CHECK_EQUAL(lost, 1);
+        close(fd);
+    }
+
+    // Mappings that are refused during the handshake which closes the socket
+    // before the connection is ever established.
+    auto refused = [] (int fd, ShmEndpoint& provider) {
+        for (size_t i = 0; i < 100; ++i) {
+            provider.poll(1);
+
+            char byte;
+            if (!recv(fd, &byte, sizeof byte, MSG_DONTWAIT)) return true;
+        }
+        return false;
+    };
+
+    {
+        size_t conns = 0;
+        ShmEndpoint provider("corrupt_ring", RingSize);
+        provider.onNewConnection = [&] (int) { conns++; };
+
+        // mappedSize wraps around for this capacity and comes out equal to
+        // the size of the header-only mapping.
+        int fd = connectRaw("corrupt_ring", 0, [] (RingHeader& ring, uint8_t*) {
+                    ring.capacity = uint64_t(1) << 63;
+                });
+        BOOST_CHECK(refused(fd, provider));
+        close(fd);
+
+        // Header that doesn't match the size of the mapping.
+        fd = connectRaw("corrupt_ring", RingSize, [] (RingHeader& ring, uint8_t*) {
+                    ring.capacity = RingSize * 2;
+                });
+        BOOST_CHECK(refused(fd, provider));
+        close(fd);
+
+        // Mapping that could be truncated under us.
+        fd = connectRaw("corrupt_ring", RingSize, [] (RingHeader&, uint8_t*) {}, 0);
+        BOOST_CHECK(refused(fd, provider));
+        close(fd);
+
+        BOOST_CHECK_EQUAL(conns, 0);
+    }
+}
@@ -0,0 +1,122 @@
+/* timeout_queue_test.cpp                                 -*- C++ -*-
+   Rémi Attab (remi.attab@gmail.com), 16 Oct 2026
+   FreeBSD-style copyright and disclaimer apply
+
+   Tests for the timing wheel.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "timeout_queue.h"
+#include "lockless/format.h"
+
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+using namespace slick;
+using namespace lockless;
+
+
+/******************************************************************************/
+/* UTILS                                                                      */
+/******************************************************************************/
+
+/** Time only moves when the test says so. */
+struct TestClock
+{
+    typedef double ClockT;
+
+    ClockT operator() () const { return now; }
+    static double toSec(ClockT t) { return t; }
+
+    static double now;
+};
+
+double TestClock::now = 0;
+
+// Power of 2 so that tick arithmetic on doubles stays exact.
+double ticks(uint64_t n) { return n / 1024.0; }
+
+
+/******************************************************************************/
+/* TESTS                                                                      */
+/******************************************************************************/
+
+BOOST_AUTO_TEST_CASE(basics)
+{
+    cerr << fmtTitle("basics", '=') << endl;
+
+    TestClock::now = 1000;
+    TimeoutQueue<size_t, TestClock> queue(ticks(1));
+
+    vector<size_t> fired;
+    queue.onTimeout = [&] (size_t key) { fired.push_back(key); };
+
+    queue.setTTL(1, ticks(5));
+    queue.setTTL(2, ticks(10));
+    queue.setTTL(3, ticks(15));
+    BOOST_CHECK_EQUAL(queue.size(), 3);
+
+    // Resetting a key replaces its deadline.
+    queue.setTTL(1, ticks(12));
+    queue.remove(3);
+    BOOST_CHECK_EQUAL(queue.size(), 2);
+
+    TestClock::now += ticks(6);
+    queue.poll();
+    BOOST_CHECK(fired.empty());
+
+    TestClock::now += ticks(5);
+    queue.poll();
+    BOOST_CHECK(fired == vector<size_t>({ 2 }));
+
+    TestClock::now += ticks(100);
+    queue.poll();
+    BOOST_CHECK(fired == vector<size_t>({ 2, 1 }));
+    BOOST_CHECK(queue.empty());
+
+    // Deadlines in the past go off on the next tick.
+    queue.set(4, TestClock::now - 10);
+    TestClock::now += ticks(1);
+    queue.poll();
+    BOOST_CHECK(fired == vector<size_t>({ 2, 1, 4 }));
+}
+
+BOOST_AUTO_TEST_CASE(levels)
+{
+    cerr << fmtTitle("levels", '=') << endl;
+
+    TestClock::now = 1000;
+    TimeoutQueue<size_t, TestClock> queue(ticks(1));
+
+    // Spread across every level of the wheel and past its edge.
+    const vector<uint64_t> delays = {
+        1, 255, 258, 1000, 65535, 65540, 70000,
+        1U << 24, (1U << 24) + 12345, 1ULL << 33
+    };
+
+    vector<size_t> fired;
+    queue.onTimeout = [&] (size_t key) { fired.push_back(key); };
+    for (size_t i = 0; i < delays.size(); ++i)
+        queue.setTTL(i, ticks(delays[i]));
+
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < delays.size(); ++i) {
+        uint64_t step = delays[i] - elapsed - 1;
+        TestClock::now += ticks(step);
+        elapsed += step;
+        queue.poll();
+        BOOST_CHECK_EQUAL(fired.size(), i);
+
+        TestClock::now += ticks(2);
+        elapsed += 2;
+        queue.poll();
+        BOOST_CHECK_EQUAL(fired.size(), i + 1);
+        if (fired.size() == i + 1) BOOST_CHECK_EQUAL(fired.back(), i);
+    }
+
+    BOOST_CHECK(queue.empty());
+}